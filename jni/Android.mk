@@ -6,4 +6,5 @@ LOCAL_SRC_FILES := SSAO_Complete.cpp
 LOCAL_LDLIBS := -llog -lGLESv3 -ldl -lm
 LOCAL_CPPFLAGS := -std=c++17 -O3 -ffast-math -fno-exceptions
 LOCAL_CFLAGS := -DNDEBUG
+# LOCAL_CFLAGS += -DSSAO_GL_TRACE # GL call tracing, see ssao_gltrace.h
 include $(BUILD_SHARED_LIBRARY)
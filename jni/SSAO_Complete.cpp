@@ -3,8 +3,22 @@
 #include <mod/config.h>
 #include <GLES3/gl3.h>
 #include <dlfcn.h>
+#include <strings.h>
 #include <cstring>
 #include <cmath>
+#include <cstdio>
+
+#include "ssao_capture.h"
+#include "ssao_gltrace.h" // before any GL call, redirects them in SSAO_GL_TRACE builds
+#include "ssao_rendergraph.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SSAO_NEON 1
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define SSAO_SSE 1
+#endif
 
 MYMOD(net.gtasa.ssao_complete, GTA SA Complete SSAO, 1.0, YourName)
 NEEDGAME(com.rockstargames.gtasa)
@@ -126,36 +140,69 @@ ConfigEntry* pBlurEnabled;
 ConfigEntry* pBlurRadius;
 ConfigEntry* pDebugMode;
 ConfigEntry* pResolutionScale; // 1.0 = full res, 0.5 = half res
+ConfigEntry* pCheckerboard;    // half the pixels per frame at full res, rest reprojected
+ConfigEntry* pAmortizeRegions; // >1 recomputes one of that many bands per frame
+ConfigEntry* pMultiRes;        // wide-radius coarse level + fine detail level
+ConfigEntry* pCoarseScale;
+ConfigEntry* pCoarseSamples;
+ConfigEntry* pCoarseRadius;
+ConfigEntry* pCaptureFrames;   // >0 records that many frames for offline replay
+ConfigEntry* pCapturePath;
+ConfigEntry* pCaptureCompress;
+ConfigEntry* pTraceFrames;     // >0 traces GL calls for that many frames (SSAO_GL_TRACE builds)
+ConfigEntry* pTracePath;
+ConfigEntry* pPreset;          // named tier from PresetFile, overrides the values above
+ConfigEntry* pPresetFile;
+ConfigEntry* pTechnique;       // SAO, HBAO or GTAO
+ConfigEntry* pFusedDenoise;    // 2x2 quad denoise inside the AO pass
+ConfigEntry* pSkyStencil;      // cull sky fragments with an early stencil test
+ConfigEntry* pAdaptiveSamples; // per-tile tap count from the projected radius
+ConfigEntry* pMinSamples;
+ConfigEntry* pTextureGather;   // GLES 3.1 gather fetch paths when available
+ConfigEntry* pStaticReuse;     // keep last frame's AO while camera and Z are unchanged
+ConfigEntry* pStaticRefresh;
 
 // ============================================================================
 // OPENGL STATE
 // ============================================================================
 
-GLuint aoProgram = 0;
 GLuint blurProgram = 0;
 GLuint compositeProgram = 0;
-
-GLuint aoFBO = 0, blurFBO = 0, compositeFBO = 0;
-GLuint aoTexture = 0, blurTexture = 0;
+GLuint skyMaskProgram = 0;
+GLuint checkerboardProgram = 0;
+bool textureGatherPath = false; // AO and blur compiled with SSAO_GATHER
+bool fineDerivatives = true;    // per-row dFdx/dFdy, which FusedDenoise needs
+
+// Render targets are transient and owned by the graph's pool; only the
+// last computed AO outlives the frame
+RenderGraph frameGraph;
+GLuint aoTexture = 0; // exported AO of the last computed frame
+GLuint checkerboardHistory = 0; // last checkerboard reconstruction, AO + view depth
+GLuint amortizedHistory = 0;    // unblurred AO the amortized mode updates band by band
 GLuint depthTexture = 0;
-GLuint sceneTexture = 0; // Copy of scene before AO
 
 GLuint quadVAO = 0, quadVBO = 0;
 
 struct AOUniforms {
     GLint depthTex;
     GLint viewMatrix, projMatrix;
-    GLint invViewMatrix, invProjMatrix;
-    GLint nearPlane, farPlane;
-    GLint screenSize;
+    GLint invViewMatrix;
+    GLint projInfo, depthParams, projScale;
+    GLint screenSize, targetSize;
     GLint samples, radius, density;
-} aoUniforms;
+    GLint coarseAOTex, coarseSize, multiRes;
+    GLint fusedDenoise;
+    GLint adaptiveSamples, minSamples;
+    GLint checkerboard;
+};
 
 struct BlurUniforms {
     GLint aoTex, depthTex;
     GLint direction;
     GLint radius;
     GLint screenSize;
+    GLint depthAligned;
+    GLint weights, linearTaps, linearTapCount;
 } blurUniforms;
 
 struct CompositeUniforms {
@@ -163,6 +210,18 @@ struct CompositeUniforms {
     GLint debugMode;
 } compositeUniforms;
 
+struct SkyMaskUniforms {
+    GLint screenSize;
+    GLint checkerboard;
+} skyMaskUniforms;
+
+struct CheckerboardUniforms {
+    GLint reprojection;
+    GLint projInfo, depthParams, projW;
+    GLint screenSize;
+    GLint parity, historyValid;
+} checkerboardUniforms;
+
 float quadVertices[] = {
     -1.0f,  1.0f,  0.0f, 1.0f,
     -1.0f, -1.0f,  0.0f, 0.0f,
@@ -176,8 +235,17 @@ float quadVertices[] = {
 // SHADER: AO COMPUTATION
 // ============================================================================
 
+// Version line prepended to every shader by CreateProgram. AO and blur
+// pick theirs at init: SSAO_GATHER swaps runs of single-texel fetches for
+// textureGather.
+const char* glslHeaderES30 = "#version 300 es\n";
+const char* glslHeaderGather = "#version 310 es\n#define SSAO_GATHER\n";
+
+const char* FetchPathHeader() {
+    return textureGatherPath ? glslHeaderGather : glslHeaderES30;
+}
+
 const char* aoVertShader = R"(
-#version 300 es
 precision highp float;
 
 layout(location = 0) in vec2 aPos;
@@ -191,8 +259,7 @@ void main() {
 }
 )";
 
-const char* aoFragShader = R"(
-#version 300 es
+const char* aoCommonFragShader = R"(
 precision highp float;
 
 in vec2 vTexCoord;
@@ -203,28 +270,49 @@ uniform sampler2D uDepthTex;
 uniform mat4 uViewMatrix;
 uniform mat4 uProjMatrix;
 uniform mat4 uInvViewMatrix;
-uniform mat4 uInvProjMatrix;
 
-uniform float uNearPlane;
-uniform float uFarPlane;
+uniform vec4 uProjInfo;    // view.xy = (uv * xy + zw) * view.z
+uniform vec2 uDepthParams; // view.z = x / (depth - y)
+uniform vec2 uProjScale;   // uv per view unit at distance 1
 uniform vec2 uScreenSize;
+uniform vec2 uTargetSize;  // pixelCoord extent: the AO or coarse level, full width when checkerboarded
 
 uniform float uSamples;
 uniform float uRadius;
 uniform float uDensity;
 
+uniform sampler2D uCoarseAOTex;
+uniform vec2 uCoarseSize;
+uniform int uMultiRes;
+
+uniform int uFusedDenoise;
+
+uniform int uAdaptiveSamples;
+uniform float uMinSamples;
+
+uniform int uCheckerboard; // -1 = off, else the parity of the shaded half
+
+// Tap budget of this pixel, uSamples or the adaptive pick. Set by main()
+// before computeAO().
+float aoSamples;
+
+// Target pixel this fragment shades, in uTargetSize units. Set by main().
+vec2 pixelCoord;
+
+// View space z from window depth
+float viewDepth(float depth) {
+    return uDepthParams.x / (depth - uDepthParams.y);
+}
+
 // Linearize depth
 float linearizeDepth(float depth) {
-    float z = depth * 2.0 - 1.0;
-    return (2.0 * uNearPlane * uFarPlane) / (uFarPlane + uNearPlane - z * (uFarPlane - uNearPlane));
+    return abs(viewDepth(depth));
 }
 
 // Reconstruct view space position
 vec3 getViewPosition(vec2 uv, float depth) {
-    vec4 ndc = vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
-    vec4 viewPos = uInvProjMatrix * ndc;
-    viewPos /= viewPos.w;
-    return viewPos.xyz;
+    float z = viewDepth(depth);
+    return vec3((uv * uProjInfo.xy + uProjInfo.zw) * z, z);
 }
 
 // Reconstruct world position
@@ -237,11 +325,26 @@ vec3 getWorldPosition(vec2 uv, float depth) {
 // Compute normal from depth derivatives
 vec3 computeNormal(vec2 uv, float depth) {
     vec2 texelSize = 1.0 / uScreenSize;
-    
+
+#ifdef SSAO_GATHER
+    // Two 2x2 footprints around our texel cover the cross: its up-left
+    // corner yields L (.w) and U (.y), its down-right corner D (.w) and
+    // R (.y). Same texels as below when the depth buffer is screen-sized.
+    vec2 depthSize = vec2(textureSize(uDepthTex, 0));
+    vec2 base = floor(uv * depthSize);
+    vec4 gatherUL = textureGather(uDepthTex, (base + vec2(0.0, 1.0)) / depthSize);
+    vec4 gatherDR = textureGather(uDepthTex, (base + vec2(1.0, 0.0)) / depthSize);
+    
+    float depthL = gatherUL.w;
+    float depthR = gatherDR.y;
+    float depthU = gatherUL.y;
+    float depthD = gatherDR.w;
+#else
     float depthL = texture(uDepthTex, uv + vec2(-texelSize.x, 0.0)).r;
     float depthR = texture(uDepthTex, uv + vec2( texelSize.x, 0.0)).r;
     float depthU = texture(uDepthTex, uv + vec2(0.0,  texelSize.y)).r;
     float depthD = texture(uDepthTex, uv + vec2(0.0, -texelSize.y)).r;
+#endif
     
     vec3 posC = getViewPosition(uv, depth);
     vec3 posL = getViewPosition(uv + vec2(-texelSize.x, 0.0), depthL);
@@ -256,8 +359,145 @@ vec3 computeNormal(vec2 uv, float depth) {
     return normal;
 }
 
+// Depth-aware upsample of the coarse level: bilinear weights on the four
+// nearest coarse texels, down-weighted where their depth differs from ours
+float upsampleCoarseAO(vec2 uv, float depth) {
+    vec2 coord = uv * uCoarseSize - 0.5;
+    vec2 base = floor(coord);
+    vec2 f = coord - base;
+    ivec2 maxTexel = ivec2(uCoarseSize) - 1;
+    float centerZ = linearizeDepth(depth);
+    
+    float totalAO = 0.0;
+    float totalWeight = 0.0;
+    for(int i = 0; i < 4; i++) {
+        vec2 o = vec2(float(i & 1), float(i >> 1));
+        vec2 texel = clamp(base + o, vec2(0.0), vec2(maxTexel));
+        
+        // Same depth texel the coarse pass shaded
+        float sampleDepth = texture(uDepthTex, (texel + 0.5) / uCoarseSize).r;
+        float sampleZ = linearizeDepth(sampleDepth);
+        
+        float w = mix(1.0 - f.x, f.x, o.x) * mix(1.0 - f.y, f.y, o.y);
+        w *= 1.0 / (0.001 + abs(sampleZ - centerZ) / centerZ);
+        
+        totalAO += texelFetch(uCoarseAOTex, ivec2(texel), 0).r * w;
+        totalWeight += w;
+    }
+    return totalAO / max(totalWeight, 1e-5);
+}
+
+// Interleaved gradient noise, decorrelates neighbouring pixels so the
+// bilateral blur can average the per-pixel rotation away
+float interleavedNoise(vec2 p) {
+    return fract(52.9829189 * fract(dot(p, vec2(0.06711056, 0.00583715))));
+}
+
+// Per-pixel sample pattern offset in [0, 1). With the fused denoise the
+// four pixels of a 2x2 quad take quarter-spaced offsets, so the quad
+// average sees four times the directions of a single pixel.
+float samplePattern() {
+    if(uFusedDenoise == 0)
+        return interleavedNoise(gl_FragCoord.xy);
+    
+    ivec2 q = ivec2(gl_FragCoord.xy) & 1;
+    float slot = float(q.x * 2 + q.y);
+    return (slot + interleavedNoise(floor(gl_FragCoord.xy * 0.5))) * 0.25;
+}
+
+// Bilateral average with the horizontal and vertical quad neighbours,
+// read through the derivative units instead of another pass. Must run in
+// uniform control flow, and needs fine derivatives (ProbeFineDerivatives):
+// with one derivative per quad the odd row gets the wrong neighbour.
+float quadDenoise(float ao, float z) {
+    vec2 side = vec2(1.0) - 2.0 * vec2(ivec2(gl_FragCoord.xy) & 1);
+    
+    float aoX = ao + dFdx(ao) * side.x;
+    float aoY = ao + dFdy(ao) * side.y;
+    float zX = z + dFdx(z) * side.x;
+    float zY = z + dFdy(z) * side.y;
+    
+    float wX = clamp(1.0 - abs(zX - z) / (0.05 * z), 0.0, 1.0);
+    float wY = clamp(1.0 - abs(zY - z) / (0.05 * z), 0.0, 1.0);
+    
+    return (ao + aoX * wX + aoY * wY) / (1.0 + wX + wY);
+}
+
+// Projected AO radius in target pixels for a view-space uRadius
+float viewRadiusPixels(float depth) {
+    vec2 r = uRadius * uProjScale * uTargetSize / linearizeDepth(depth);
+    return max(r.x, r.y);
+}
+
+// Provided by the technique body
+float computeAO(vec2 uv, float depth);
+float aoRadiusPixels(vec2 uv, float depth);
+
+const float ADAPTIVE_TILE = 8.0;
+const float ADAPTIVE_PIXELS_PER_SAMPLE = 1.5;
+
+// Tap count from the kernel's footprint: once the radius covers only a
+// few target pixels, extra taps land on the same texels. Evaluated at the
+// tile centre so whole 8x8 target tiles take the same loop count, rounded up to a
+// multiple of 4 to keep the direction/slice split of HBAO and GTAO even.
+float selectSampleCount(float depth) {
+    if(uAdaptiveSamples == 0)
+        return uSamples;
+    
+    vec2 tileUV = (floor(pixelCoord / ADAPTIVE_TILE) + 0.5) * ADAPTIVE_TILE / uTargetSize;
+    float tileDepth = texture(uDepthTex, tileUV).r;
+    if(tileDepth >= 0.9999)
+        tileDepth = depth;
+    
+    float n = aoRadiusPixels(tileUV, tileDepth) / ADAPTIVE_PIXELS_PER_SAMPLE;
+    n = ceil(clamp(n, uMinSamples, uSamples) * 0.25) * 4.0;
+    return min(n, uSamples);
+}
+
+// Checkerboard mode renders into a half-width target: texel i of row j
+// shades screen pixel 2i + ((j + parity) & 1)
+vec2 checkerboardPixel() {
+    ivec2 t = ivec2(gl_FragCoord.xy);
+    return vec2(float(2 * t.x + ((t.y + uCheckerboard) & 1)), float(t.y)) + 0.5;
+}
+
+void main() {
+    vec2 uv = vTexCoord;
+    pixelCoord = gl_FragCoord.xy;
+    if(uCheckerboard >= 0) {
+        pixelCoord = checkerboardPixel();
+        uv = pixelCoord / uTargetSize;
+    }
+    
+    float depth = texture(uDepthTex, uv).r;
+    bool sky = depth >= 0.9999;
+    
+    float ao = 1.0;
+    if(!sky) {
+        aoSamples = selectSampleCount(depth);
+        ao = computeAO(uv, depth);
+        
+        // Keep the stronger of the fine detail and the wide-radius occlusion
+        if(uMultiRes == 1)
+            ao = min(ao, upsampleCoarseAO(uv, depth));
+    }
+    
+    // Sky neighbours are rejected by the depth weight
+    if(uFusedDenoise == 1)
+        ao = quadDenoise(ao, linearizeDepth(depth));
+    
+    FragColor = sky ? 1.0 : ao;
+}
+)";
+
+// ============================================================================
+// SHADER: AO TECHNIQUE BODIES
+// ============================================================================
+// Appended to aoCommonFragShader, each defines computeAO(uv, depth).
+
+const char* saoFragShader = R"(
 // SAO Algorithm (from _AO.fx)
-float computeAO(vec3 worldPos, float curDepth, vec3 normal) {
+float computeSAO(vec2 uv0, vec3 worldPos, float curDepth, vec3 normal) {
     if(curDepth >= 0.9999) return 1.0;
     
     float d0 = curDepth;
@@ -268,11 +508,17 @@ float computeAO(vec3 worldPos, float curDepth, vec3 normal) {
     
     float ao = 0.0;
     float sr = -2.5;
-    float samples = uSamples;
+    float samples = aoSamples;
     float d = uRadius / (samples * (n.z + sr));
     
     vec2 dir = vec2(sin(42.528), cos(42.528)) * d;
     
+    // Spread the spiral start across the quad for the fused denoise
+    if(uFusedDenoise == 1) {
+        float a = samplePattern() * 6.2831853;
+        dir = mat2(cos(a), sin(a), -sin(a), cos(a)) * dir;
+    }
+    
     float radius = linDepth;
     float aoRadius = 0.5 * linDepth;
     aoRadius = 1.0 - aoRadius;
@@ -282,7 +528,7 @@ float computeAO(vec3 worldPos, float curDepth, vec3 normal) {
     mat2 rot = mat2(0.76465, -0.64444, 0.64444, 0.76465);
     
     for(float i = 1.0; i < samples; i += 1.0) {
-        vec2 uv = vTexCoord + (dir * i / 0.5) * radius;
+        vec2 uv = uv0 + (dir * i / 0.5) * radius;
         
         if(uv.x > 1.0 || uv.x < 0.0 || uv.y > 1.0 || uv.y < 0.0)
             break;
@@ -302,23 +548,147 @@ float computeAO(vec3 worldPos, float curDepth, vec3 normal) {
         dir = rot * dir;
     }
     
-    return pow(1.0 - pow(ao / samples, 1.0) * uDensity, 1.0);
+    return clamp(1.0 - ao / samples * uDensity, 0.0, 1.0);
 }
 
-void main() {
-    float depth = texture(uDepthTex, vTexCoord).r;
+float computeAO(vec2 uv, float depth) {
+    vec3 worldPos = getWorldPosition(uv, depth);
+    vec3 normal = computeNormal(uv, depth);
+    return computeSAO(uv, worldPos, depth, normal);
+}
+
+// Spiral extent of computeSAO for a typical normal (|n.z + sr| ~ 2.5)
+float aoRadiusPixels(vec2 uv, float depth) {
+    float linDepth = 1.0 * 0.05 / (1.0 + depth * (0.05 - 1.0));
+    float aoRadius = min(1.0 - 0.5 * linDepth, 0.14);
+    float radius = mix(0.7 * aoRadius, 0.16 * aoRadius, linDepth);
+    return 2.0 * radius * uRadius / 2.5 * max(uTargetSize.x, uTargetSize.y);
+}
+)";
+
+// HBAO (HBAO+ formulation): march a few directions out to the projected
+// radius and accumulate how far each sample rises above the tangent plane
+const char* hbaoFragShader = R"(
+const int HBAO_DIRECTIONS = 4;
+const float HBAO_BIAS = 0.1;
+
+float aoRadiusPixels(vec2 uv, float depth) {
+    return viewRadiusPixels(depth);
+}
+
+float computeAO(vec2 uv, float depth) {
+    vec3 pos = getViewPosition(uv, depth);
+    vec3 n = computeNormal(uv, depth);
+    n = faceforward(n, pos, n);
     
-    if(depth >= 0.9999) {
-        FragColor = 1.0;
-        return;
-    }
+    vec2 radiusUV = uRadius * uProjScale / abs(pos.z);
+    if(max(radiusUV.x * uScreenSize.x, radiusUV.y * uScreenSize.y) < 1.0)
+        return 1.0;
+    
+    int steps = max(int(aoSamples) / HBAO_DIRECTIONS, 1);
+    float noise = samplePattern();
+    float negInvR2 = -1.0 / (uRadius * uRadius);
     
-    vec3 worldPos = getWorldPosition(vTexCoord, depth);
-    vec3 normal = computeNormal(vTexCoord, depth);
+    float ao = 0.0;
+    for(int d = 0; d < HBAO_DIRECTIONS; d++) {
+        float angle = (float(d) + noise) * (6.2831853 / float(HBAO_DIRECTIONS));
+        vec2 stepUV = vec2(cos(angle), sin(angle)) * radiusUV / float(steps);
+        vec2 sampleUV = uv + stepUV * noise;
+        
+        for(int i = 0; i < steps; i++) {
+            sampleUV += stepUV;
+            
+            float sampleDepth = texture(uDepthTex, sampleUV).r;
+            vec3 v = getViewPosition(sampleUV, sampleDepth) - pos;
+            float vv = dot(v, v);
+            float nv = dot(n, v) * inversesqrt(vv + 1e-6);
+            
+            ao += clamp(nv - HBAO_BIAS, 0.0, 1.0) * clamp(vv * negInvR2 + 1.0, 0.0, 1.0);
+        }
+    }
     
-    float ao = computeAO(worldPos, depth, normal);
+    ao *= 1.0 / ((1.0 - HBAO_BIAS) * float(HBAO_DIRECTIONS * steps));
+    return clamp(1.0 - ao * uDensity, 0.0, 1.0);
+}
+)";
+
+// Ground-Truth AO: per slice, search the horizon on both sides within the
+// radius and integrate cosine-weighted visibility analytically against the
+// normal projected into the slice
+const char* gtaoFragShader = R"(
+const int GTAO_SLICES = 2;
+const float HALF_PI = 1.5707963;
+
+float aoRadiusPixels(vec2 uv, float depth) {
+    return viewRadiusPixels(depth);
+}
+
+float computeAO(vec2 uv, float depth) {
+    vec3 pos = getViewPosition(uv, depth);
+    vec3 n = computeNormal(uv, depth);
+    n = faceforward(n, pos, n);
+    vec3 v = normalize(-pos);
+    
+    vec2 radiusUV = uRadius * uProjScale / abs(pos.z);
+    if(max(radiusUV.x * uScreenSize.x, radiusUV.y * uScreenSize.y) < 1.0)
+        return 1.0;
+    
+    int steps = max(int(aoSamples) / (2 * GTAO_SLICES), 1);
+    float noise = samplePattern();
+    float stepNoise = fract(noise * 7.0 + 0.5);
+    float invR2 = 1.0 / (uRadius * uRadius);
+    
+    float visibility = 0.0;
+    for(int slice = 0; slice < GTAO_SLICES; slice++) {
+        float phi = (float(slice) + noise) * (3.1415927 / float(GTAO_SLICES));
+        vec2 omega = vec2(cos(phi), sin(phi));
+        
+        // Normal projected into the slice plane and its angle to the view vector
+        vec3 dir = vec3(omega, 0.0);
+        vec3 orthoDir = dir - dot(dir, v) * v;
+        vec3 axis = normalize(cross(orthoDir, v));
+        vec3 projN = n - axis * dot(n, axis);
+        float projNLen = length(projN);
+        float cosN = clamp(dot(projN, v) / max(projNLen, 1e-4), 0.0, 1.0);
+        float angleN = sign(dot(orthoDir, projN)) * acos(cosN);
+        
+        float lowCos0 = cos(angleN + HALF_PI);
+        float lowCos1 = cos(angleN - HALF_PI);
+        float horizonCos0 = lowCos0;
+        float horizonCos1 = lowCos1;
+        
+        for(int i = 0; i < steps; i++) {
+            // Quadratic spacing puts more taps near the center
+            float t = (float(i) + stepNoise) / float(steps);
+            vec2 offset = omega * radiusUV * (t * t) + omega / uScreenSize;
+            
+            vec2 uv0 = uv + offset;
+            vec2 uv1 = uv - offset;
+            vec3 d0 = getViewPosition(uv0, texture(uDepthTex, uv0).r) - pos;
+            vec3 d1 = getViewPosition(uv1, texture(uDepthTex, uv1).r) - pos;
+            
+            float len0 = length(d0);
+            float len1 = length(d1);
+            float w0 = clamp(1.0 - len0 * len0 * invR2, 0.0, 1.0);
+            float w1 = clamp(1.0 - len1 * len1 * invR2, 0.0, 1.0);
+            
+            horizonCos0 = max(horizonCos0, mix(lowCos0, dot(d0, v) / max(len0, 1e-5), w0));
+            horizonCos1 = max(horizonCos1, mix(lowCos1, dot(d1, v) / max(len1, 1e-5), w1));
+        }
+        
+        float h0 = -acos(clamp(horizonCos1, -1.0, 1.0));
+        float h1 = acos(clamp(horizonCos0, -1.0, 1.0));
+        h0 = angleN + max(h0 - angleN, -HALF_PI);
+        h1 = angleN + min(h1 - angleN, HALF_PI);
+        
+        float sinN = sin(angleN);
+        float arc0 = cosN + 2.0 * h0 * sinN - cos(2.0 * h0 - angleN);
+        float arc1 = cosN + 2.0 * h1 * sinN - cos(2.0 * h1 - angleN);
+        visibility += projNLen * 0.25 * (arc0 + arc1);
+    }
     
-    FragColor = ao;
+    visibility /= float(GTAO_SLICES);
+    return clamp(1.0 - (1.0 - visibility) * uDensity, 0.0, 1.0);
 }
 )";
 
@@ -327,7 +697,6 @@ void main() {
 // ============================================================================
 
 const char* blurFragShader = R"(
-#version 300 es
 precision highp float;
 
 in vec2 vTexCoord;
@@ -338,70 +707,258 @@ uniform sampler2D uDepthTex;
 uniform int uDirection;
 uniform float uRadius;
 uniform vec2 uScreenSize;
+uniform int uDepthAligned; // depth texture has the AO target's size
+
+// Filled by SetBlurKernel. Must match SSAO_BLUR_MAX_RADIUS.
+const int BLUR_MAX_RADIUS = 8;
+uniform float uWeights[BLUR_MAX_RADIUS + 1];         // Gaussian weight per texel offset
+uniform vec2 uLinearTaps[(BLUR_MAX_RADIUS + 1) / 2]; // (offset, weight) of merged texel pairs
+uniform int uLinearTapCount;
 
 const float BLUR_SHARPNESS = 50.0;
-const float BLUR_FALLOFF = 1.0 / (2.0 * 2.0); // 1/(2*sigma^2)
+const float LOG2_E = 1.442695;
+
+// Largest exponent gap between the two texels of a merged tap, i.e. their
+// depth weights differ by at most ~5%
+const float BLUR_MERGE_TOLERANCE = 0.05;
+
+// exp(-50|dz|) as a bare exp2: log2(e) folds into the sharpness, leaving
+// one special-function op per tap, the same cost as a reciprocal
+float depthWeight(float depthDiff) {
+    return exp2(-abs(depthDiff) * (BLUR_SHARPNESS * LOG2_E));
+}
+
+#ifdef SSAO_GATHER
+// Taps k and k+1 along dir from one textureGather. The coordinate sits on
+// the edge between the two texels and a quarter texel across, so the
+// footprint's first row (column) is the blurred line: .w is tap k, .z
+// (horizontal) or .x (vertical) is tap k+1.
+vec2 gatherPair(sampler2D tex, vec2 uvK, vec2 dir, vec2 texelSize) {
+    vec2 across = vec2(1.0) - dir;
+    vec4 g = textureGather(tex, uvK + (dir * 0.5 + across * 0.25) * texelSize);
+    return vec2(g.w, dir.x > 0.5 ? g.z : g.x);
+}
+
+vec2 gatherDepthPair(vec2 uvK, vec2 dir, vec2 texelSize) {
+    if(uDepthAligned == 1)
+        return gatherPair(uDepthTex, uvK, dir, texelSize);
+    return vec2(texture(uDepthTex, uvK).r, texture(uDepthTex, uvK + dir * texelSize).r);
+}
 
-float gaussian(float x, float sigma) {
-    return exp(-(x * x) * BLUR_FALLOFF);
+void accumulateTap(float ao, float depth, int dist, float centerDepth,
+                   inout float totalAO, inout float totalWeight) {
+    float weight = uWeights[dist] * depthWeight(centerDepth - depth);
+    totalAO += ao * weight;
+    totalWeight += weight;
 }
+#endif
 
+// Out-of-range taps read the clamped edge texel (CLAMP_TO_EDGE on both
+// textures) instead of being skipped
 void main() {
     vec2 texelSize = 1.0 / uScreenSize;
     vec2 dir = (uDirection == 0) ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
     
     float centerDepth = texture(uDepthTex, vTexCoord).r;
-    float centerAO = texture(uAOTex, vTexCoord).r;
     
     if(centerDepth >= 0.9999) {
         FragColor = 1.0;
         return;
     }
+
+#ifdef SSAO_GATHER
+    int radius = min(int(uRadius), BLUR_MAX_RADIUS);
+    vec2 stepUV = dir * texelSize;
+    float totalAO = 0.0;
+    float totalWeight = 0.0;
+    
+    // Pairs (0,1), (2,3), ...: the centre and the positive side
+    for(int k = 0; k <= radius; k += 2) {
+        vec2 uvK = vTexCoord + stepUV * float(k);
+        vec2 ao = gatherPair(uAOTex, uvK, dir, texelSize);
+        vec2 z = gatherDepthPair(uvK, dir, texelSize);
+        
+        accumulateTap(ao.x, z.x, k, centerDepth, totalAO, totalWeight);
+        if(k + 1 <= radius)
+            accumulateTap(ao.y, z.y, k + 1, centerDepth, totalAO, totalWeight);
+    }
     
-    float totalWeight = gaussian(0.0, uRadius);
-    float totalAO = centerAO * totalWeight;
-    
-    int radius = int(uRadius);
-    for(int i = 1; i <= radius; i++) {
-        vec2 offset = dir * texelSize * float(i);
+    // Pairs (-2,-1), (-4,-3), ...: the negative side
+    for(int k = 1; k <= radius; k += 2) {
+        vec2 uvK = vTexCoord - stepUV * float(k + 1);
+        vec2 ao = gatherPair(uAOTex, uvK, dir, texelSize);
+        vec2 z = gatherDepthPair(uvK, dir, texelSize);
         
-        // Positive direction
-        vec2 uvPos = vTexCoord + offset;
-        if(uvPos.x >= 0.0 && uvPos.x <= 1.0 && uvPos.y >= 0.0 && uvPos.y <= 1.0) {
-            float sampleDepth = texture(uDepthTex, uvPos).r;
-            float sampleAO = texture(uAOTex, uvPos).r;
-            
-            float depthDiff = abs(centerDepth - sampleDepth);
-            float weight = gaussian(float(i), uRadius) * exp(-depthDiff * BLUR_SHARPNESS);
-            
-            totalAO += sampleAO * weight;
-            totalWeight += weight;
-        }
+        accumulateTap(ao.y, z.y, k, centerDepth, totalAO, totalWeight);
+        if(k + 1 <= radius)
+            accumulateTap(ao.x, z.x, k + 1, centerDepth, totalAO, totalWeight);
+    }
+#else
+    float totalWeight = uWeights[0];
+    float totalAO = texture(uAOTex, vTexCoord).r * totalWeight;
+    
+    // Each tap is the texel pair (k, k+1) merged into one bilinear AO fetch,
+    // which is only exact while both texels get the same depth weight. Pairs
+    // that straddle a depth edge fall back to two point taps.
+    for(int i = 0; i < uLinearTapCount; i++) {
+        int k = 2 * i + 1;
         
-        // Negative direction
-        vec2 uvNeg = vTexCoord - offset;
-        if(uvNeg.x >= 0.0 && uvNeg.x <= 1.0 && uvNeg.y >= 0.0 && uvNeg.y <= 1.0) {
-            float sampleDepth = texture(uDepthTex, uvNeg).r;
-            float sampleAO = texture(uAOTex, uvNeg).r;
+        for(float side = -1.0; side <= 1.0; side += 2.0) {
+            vec2 stepUV = dir * texelSize * side;
+            vec2 uv0 = vTexCoord + stepUV * float(k);
+            vec2 uv1 = uv0 + stepUV;
+            float z0 = texture(uDepthTex, uv0).r;
+            float z1 = texture(uDepthTex, uv1).r;
             
-            float depthDiff = abs(centerDepth - sampleDepth);
-            float weight = gaussian(float(i), uRadius) * exp(-depthDiff * BLUR_SHARPNESS);
-            
-            totalAO += sampleAO * weight;
-            totalWeight += weight;
+            if(abs(z0 - z1) * BLUR_SHARPNESS < BLUR_MERGE_TOLERANCE) {
+                float w = uLinearTaps[i].y * depthWeight(centerDepth - 0.5 * (z0 + z1));
+                totalAO += texture(uAOTex, vTexCoord + stepUV * uLinearTaps[i].x).r * w;
+                totalWeight += w;
+            } else {
+                float w0 = uWeights[k] * depthWeight(centerDepth - z0);
+                float w1 = uWeights[k + 1] * depthWeight(centerDepth - z1);
+                totalAO += texture(uAOTex, uv0).r * w0 + texture(uAOTex, uv1).r * w1;
+                totalWeight += w0 + w1;
+            }
         }
     }
+#endif
     
     FragColor = totalAO / totalWeight;
 }
 )";
 
+// ============================================================================
+// SHADER: SKY MASK
+// ============================================================================
+
+// Stencil prepass: one depth tap, geometry pixels survive and get ref 1.
+// AO and blur then run with stencil == 1, so sky fragments are rejected
+// before shading instead of by the depth test inside those shaders.
+const char* skyMaskFragShader = R"(
+precision highp float;
+
+in vec2 vTexCoord;
+
+uniform sampler2D uDepthTex;
+uniform vec2 uScreenSize;
+uniform int uCheckerboard; // same half-width mapping as the AO pass
+
+void main() {
+    vec2 uv = vTexCoord;
+    if(uCheckerboard >= 0) {
+        ivec2 t = ivec2(gl_FragCoord.xy);
+        uv = (vec2(float(2 * t.x + ((t.y + uCheckerboard) & 1)), float(t.y)) + 0.5) / uScreenSize;
+    }
+    
+    if(texture(uDepthTex, uv).r >= 0.9999)
+        discard;
+}
+)";
+
+// ============================================================================
+// SHADER: CHECKERBOARD RECONSTRUCTION
+// ============================================================================
+
+// Fills the pixels the checkerboard AO pass skipped. Output is the AO plus
+// the view depth it belongs to, kept as next frame's history: a skipped
+// pixel takes its own surface point from the history when the depth stored
+// there matches, clamped to the range of its four shaded neighbours so
+// moving occluders leave no trails. Otherwise the depth-weighted average of
+// those neighbours is used.
+const char* checkerboardFragShader = R"(
+precision highp float;
+
+out vec2 FragColor;
+
+uniform sampler2D uAOTex;      // shaded half, see checkerboardPixel()
+uniform sampler2D uDepthTex;
+uniform sampler2D uHistoryTex; // last reconstruction: AO, view depth
+
+uniform mat4 uReprojection;    // view space -> previous clip space
+uniform vec4 uProjInfo;
+uniform vec2 uDepthParams;
+uniform float uProjW;          // clip w per unit of view z
+uniform vec2 uScreenSize;
+uniform int uParity;
+uniform int uHistoryValid;
+
+float viewDepth(float depth) {
+    return uDepthParams.x / (depth - uDepthParams.y);
+}
+
+float depthAt(ivec2 p) {
+    return texture(uDepthTex, (vec2(p) + 0.5) / uScreenSize).r;
+}
+
+float shadedAO(ivec2 p) {
+    return texelFetch(uAOTex, ivec2(p.x >> 1, p.y), 0).r;
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    float depth = depthAt(p);
+    float z = abs(viewDepth(depth));
+    
+    if(depth >= 0.9999) {
+        FragColor = vec2(1.0, z);
+        return;
+    }
+    if(((p.x + p.y + uParity) & 1) == 0) {
+        FragColor = vec2(shadedAO(p), z);
+        return;
+    }
+    
+    // The four edge neighbours were all shaded this frame
+    const ivec2 offsets[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+    ivec2 size = ivec2(uScreenSize);
+    float total = 0.0, totalWeight = 0.0;
+    float plain = 0.0, plainCount = 0.0;
+    float lo = 1.0, hi = 0.0;
+    for(int i = 0; i < 4; i++) {
+        ivec2 q = p + offsets[i];
+        if(any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size)))
+            continue;
+        
+        float ao = shadedAO(q);
+        float w = clamp(1.0 - abs(abs(viewDepth(depthAt(q))) - z) / (0.05 * z), 0.0, 1.0);
+        if(w > 0.0) {
+            lo = min(lo, ao);
+            hi = max(hi, ao);
+        }
+        total += ao * w;
+        totalWeight += w;
+        plain += ao;
+        plainCount += 1.0;
+    }
+    
+    if(uHistoryValid == 1) {
+        vec2 uv = (vec2(p) + 0.5) / uScreenSize;
+        float vz = viewDepth(depth);
+        vec4 clip = uReprojection * vec4((uv * uProjInfo.xy + uProjInfo.zw) * vz, vz, 1.0);
+        vec2 prevUV = clip.xy / clip.w * 0.5 + 0.5;
+        
+        if(all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0)))) {
+            vec2 history = texture(uHistoryTex, prevUV).rg;
+            float prevZ = abs(clip.w / uProjW);
+            if(abs(history.g - prevZ) < 0.05 * prevZ) {
+                FragColor = vec2(totalWeight > 0.0 ? clamp(history.r, lo, hi) : history.r, z);
+                return;
+            }
+        }
+    }
+    
+    // Thin features with no matching neighbour take the plain average
+    float ao = totalWeight > 0.0 ? total / totalWeight : plain / max(plainCount, 1.0);
+    FragColor = vec2(ao, z);
+}
+)";
+
 // ============================================================================
 // SHADER: COMPOSITE
 // ============================================================================
 
 const char* compositeFragShader = R"(
-#version 300 es
 precision highp float;
 
 in vec2 vTexCoord;
@@ -432,13 +989,48 @@ void main() {
 }
 )";
 
+// ============================================================================
+// SHADER: DERIVATIVE PROBE
+// ============================================================================
+
+// quadDenoise rebuilds a neighbour as v + dFdx(v), which is only that
+// neighbour with per-row (fine) derivatives. GLSL ES 3.00 allows one
+// coarse derivative per 2x2 quad, so the driver is tested at init: the
+// horizontal slope is 1 on even rows and 3 on odd rows.
+const char* derivativeProbeVertShader = R"(
+void main() {
+    // Full-screen triangle from gl_VertexID, no vertex buffer
+    vec2 p = vec2(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1));
+    gl_Position = vec4(p, 0.0, 1.0);
+}
+)";
+
+const char* derivativeProbeFragShader = R"(
+precision highp float;
+
+out vec4 FragColor;
+
+void main() {
+    float slope = 1.0 + 2.0 * mod(floor(gl_FragCoord.y), 2.0);
+    FragColor = vec4(dFdx(gl_FragCoord.x * slope) * 0.25, 0.0, 0.0, 1.0);
+}
+)";
+
 // ============================================================================
 // SHADER COMPILATION
 // ============================================================================
 
-GLuint CompileShader(GLenum type, const char* source) {
+// body, if given, is appended to source (shared prelude + variant)
+// header, when given, goes first (version line and defines)
+GLuint CompileShader(GLenum type, const char* source, const char* body = nullptr,
+                     const char* header = nullptr) {
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, nullptr);
+    const char* sources[3];
+    GLsizei count = 0;
+    if(header) sources[count++] = header;
+    sources[count++] = source;
+    if(body) sources[count++] = body;
+    glShaderSource(shader, count, sources, nullptr);
     glCompileShader(shader);
     
     GLint success;
@@ -447,35 +1039,43 @@ GLuint CompileShader(GLenum type, const char* source) {
         char log[1024];
         glGetShaderInfoLog(shader, 1024, nullptr, log);
         logger->Error("Shader compile error:\n%s", log);
+        glDeleteShader(shader);
         return 0;
     }
     
     return shader;
 }
 
-GLuint CreateProgram(const char* vertSrc, const char* fragSrc) {
-    GLuint vert = CompileShader(GL_VERTEX_SHADER, vertSrc);
-    GLuint frag = CompileShader(GL_FRAGMENT_SHADER, fragSrc);
+GLuint CreateProgram(const char* vertSrc, const char* fragSrc, const char* fragBody = nullptr,
+                     const char* header = glslHeaderES30) {
+    GLuint vert = CompileShader(GL_VERTEX_SHADER, vertSrc, nullptr, header);
+    GLuint frag = CompileShader(GL_FRAGMENT_SHADER, fragSrc, fragBody, header);
     
-    if(!vert || !frag) return 0;
+    if(!vert || !frag) {
+        if(vert) glDeleteShader(vert);
+        if(frag) glDeleteShader(frag);
+        return 0;
+    }
     
     GLuint program = glCreateProgram();
     glAttachShader(program, vert);
     glAttachShader(program, frag);
     glLinkProgram(program);
     
+    // The program keeps the shaders alive while they are attached
+    glDeleteShader(vert);
+    glDeleteShader(frag);
+    
     GLint success;
     glGetProgramiv(program, GL_LINK_STATUS, &success);
     if(!success) {
         char log[1024];
         glGetProgramInfoLog(program, 1024, nullptr, log);
         logger->Error("Program link error:\n%s", log);
+        glDeleteProgram(program);
         return 0;
     }
     
-    glDeleteShader(vert);
-    glDeleteShader(frag);
-    
     return program;
 }
 
@@ -483,8 +1083,8 @@ GLuint CreateProgram(const char* vertSrc, const char* fragSrc) {
 // MATRIX UTILITIES
 // ============================================================================
 
-void Matrix4x4Invert(const float* m, float* out) {
-    // 4x4 matrix inversion
+bool Matrix4x4Invert(const float* m, float* out) {
+    // Generic 4x4 cofactor inversion, returns false for singular matrices
     float inv[16];
     
     inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + 
@@ -525,17 +1125,13 @@ void Matrix4x4Invert(const float* m, float* out) {
     
     float det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
     
-    if(fabs(det) < 0.0001f) {
-        // Singular matrix, return identity
-        memset(out, 0, 16 * sizeof(float));
-        out[0] = out[5] = out[10] = out[15] = 1.0f;
-        return;
-    }
+    if(fabsf(det) < 1e-8f) return false;
     
     det = 1.0f / det;
     
     for(int i = 0; i < 16; i++)
         out[i] = inv[i] * det;
+    return true;
 }
 
 void ConvertRwMatrixToGL(const RwMatrix* rw, float* gl) {
@@ -547,73 +1143,479 @@ void ConvertRwMatrixToGL(const RwMatrix* rw, float* gl) {
 }
 
 // ============================================================================
-// INITIALIZATION
+// CAMERA CONSTANTS
 // ============================================================================
 
-bool InitAddresses() {
-    logger->Info("Resolving addresses...");
-    
-    void* lib = dlopen("libGTASA.so", RTLD_NOW);
-    if(!lib) {
-        logger->Error("Failed to load libGTASA.so");
-        return false;
+// Column-major 4x4 helpers. NEON on the device, SSE on desktop builds,
+// scalar everywhere else.
+
+void Mat4Mul(const float* a, const float* b, float* out) {
+    // out = a * b
+    float tmp[16];
+#if defined(SSAO_NEON)
+    float32x4_t a0 = vld1q_f32(a), a1 = vld1q_f32(a + 4);
+    float32x4_t a2 = vld1q_f32(a + 8), a3 = vld1q_f32(a + 12);
+    for(int c = 0; c < 4; c++) {
+        float32x4_t r = vmulq_n_f32(a0, b[c*4 + 0]);
+        r = vmlaq_n_f32(r, a1, b[c*4 + 1]);
+        r = vmlaq_n_f32(r, a2, b[c*4 + 2]);
+        r = vmlaq_n_f32(r, a3, b[c*4 + 3]);
+        vst1q_f32(tmp + c*4, r);
     }
+#elif defined(SSAO_SSE)
+    __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4);
+    __m128 a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    for(int c = 0; c < 4; c++) {
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[c*4 + 0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[c*4 + 1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[c*4 + 2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[c*4 + 3])));
+        _mm_storeu_ps(tmp + c*4, r);
+    }
+#else
+    for(int c = 0; c < 4; c++)
+        for(int r = 0; r < 4; r++)
+            tmp[c*4 + r] = a[r]    * b[c*4 + 0] + a[4 + r]  * b[c*4 + 1] +
+                           a[8 + r] * b[c*4 + 2] + a[12 + r] * b[c*4 + 3];
+#endif
+    memcpy(out, tmp, sizeof(tmp));
+}
+
+// Inverse of a rotation+translation matrix: [R t] -> [R^T -R^T*t].
+// Returns false if the matrix carries scale, shear or projection so the
+// caller can fall back to Matrix4x4Invert.
+bool Mat4InvertRigid(const float* m, float* out) {
+    const float eps = 1e-3f;
+    if(fabsf(m[3]) > eps || fabsf(m[7]) > eps || fabsf(m[11]) > eps ||
+       fabsf(m[15] - 1.0f) > eps)
+        return false;
     
-    #define RESOLVE(name, offset) \
-        name = (decltype(name))((uintptr_t)lib + offset); \
-        if(!name) logger->Error("Failed to resolve " #name);
+    for(int c = 0; c < 3; c++) {
+        const float* col = m + c*4;
+        if(fabsf(col[0]*col[0] + col[1]*col[1] + col[2]*col[2] - 1.0f) > eps)
+            return false;
+    }
+    if(fabsf(m[0]*m[4] + m[1]*m[5] + m[2]*m[6]) > eps ||
+       fabsf(m[0]*m[8] + m[1]*m[9] + m[2]*m[10]) > eps ||
+       fabsf(m[4]*m[8] + m[5]*m[9] + m[6]*m[10]) > eps)
+        return false;
     
-    RESOLVE(_rwCameraValRender_orig, 0x001d7140);
-    RESOLVE(GetCurrentViewMatrix, 0x001ba6e0);
-    RESOLVE(GetCurrentProjectionMatrix, 0x001ba6f8);
-    RESOLVE(SetupScreenSpaceProjection, 0x001ada2c);
-    RESOLVE(RwRasterLock, 0x001daaf4);
-    RESOLVE(RwRasterUnlock, 0x001da738);
-    RESOLVE(RwRasterCreate, 0x001daa50);
-    RESOLVE(RwRasterDestroy, 0x001da850);
-    RESOLVE(RwMatrixInvert, 0x001e3a28);
-    RESOLVE(RwV3dTransformPoint, 0x001e698c);
-    RESOLVE(_rwOpenGLGetEngineZBufferDepth, 0x001b13bc);
-    RESOLVE(RwRasterShowRaster, 0x001da9bc);
+    float tmp[16];
+#if defined(SSAO_NEON)
+    // Transpose the upper 3x3 with column 3 replaced by (0,0,0,1)
+    float32x4_t c0 = vld1q_f32(m), c1 = vld1q_f32(m + 4), c2 = vld1q_f32(m + 8);
+    float32x4_t c3 = {0.0f, 0.0f, 0.0f, 1.0f};
+    float32x4x2_t t01 = vtrnq_f32(c0, c1);
+    float32x4x2_t t23 = vtrnq_f32(c2, c3);
+    float32x4_t r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    float32x4_t r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    float32x4_t r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    float32x4_t t = vmulq_n_f32(r0, -m[12]);
+    t = vmlsq_n_f32(t, r1, m[13]);
+    t = vmlsq_n_f32(t, r2, m[14]);
+    t = vsetq_lane_f32(1.0f, t, 3);
+    vst1q_f32(tmp, r0);
+    vst1q_f32(tmp + 4, r1);
+    vst1q_f32(tmp + 8, r2);
+    vst1q_f32(tmp + 12, t);
+#elif defined(SSAO_SSE)
+    __m128 r0 = _mm_loadu_ps(m), r1 = _mm_loadu_ps(m + 4);
+    __m128 r2 = _mm_loadu_ps(m + 8), r3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    __m128 t = _mm_mul_ps(r0, _mm_set1_ps(-m[12]));
+    t = _mm_sub_ps(t, _mm_mul_ps(r1, _mm_set1_ps(m[13])));
+    t = _mm_sub_ps(t, _mm_mul_ps(r2, _mm_set1_ps(m[14])));
+    _mm_storeu_ps(tmp, r0);
+    _mm_storeu_ps(tmp + 4, r1);
+    _mm_storeu_ps(tmp + 8, r2);
+    _mm_storeu_ps(tmp + 12, t);
+    tmp[15] = 1.0f;
+#else
+    for(int c = 0; c < 3; c++)
+        for(int r = 0; r < 3; r++)
+            tmp[c*4 + r] = m[r*4 + c];
+    for(int r = 0; r < 3; r++)
+        tmp[12 + r] = -(m[r*4 + 0]*m[12] + m[r*4 + 1]*m[13] + m[r*4 + 2]*m[14]);
+    tmp[3] = tmp[7] = tmp[11] = 0.0f;
+    tmp[15] = 1.0f;
+#endif
+    memcpy(out, tmp, sizeof(tmp));
+    return true;
+}
+
+// Analytic inverse of a perspective projection of the form
+//   | a 0 c 0 |
+//   | 0 b d 0 |
+//   | 0 0 e f |
+//   | 0 0 g 0 |
+// Returns false for anything else (orthographic, oblique, degenerate).
+// The shader's view-space reconstruction only holds for this layout, so
+// UpdateCameraConstants rejects the others.
+bool Mat4InvertPerspective(const float* p, float* out) {
+    float a = p[0], b = p[5], c = p[8], d = p[9];
+    float e = p[10], f = p[14], g = p[11];
+    
+    if(p[1] != 0.0f || p[2] != 0.0f || p[3] != 0.0f ||
+       p[4] != 0.0f || p[6] != 0.0f || p[7] != 0.0f ||
+       p[12] != 0.0f || p[13] != 0.0f || p[15] != 0.0f)
+        return false;
+    if(a == 0.0f || b == 0.0f || f == 0.0f || g == 0.0f)
+        return false;
     
-    g_pZBuffer = (RwRaster**)((uintptr_t)lib + 0x00a5a138);
-    g_rwRaster_cpPixels = (unsigned char**)((uintptr_t)lib + 0x0067a044);
-    g_TheCamera = (void*)((uintptr_t)lib + 0x00951fa8);
+    memset(out, 0, 16 * sizeof(float));
+    out[0] = 1.0f / a;
+    out[5] = 1.0f / b;
+    out[11] = 1.0f / f;
+    out[12] = -c / (a * g);
+    out[13] = -d / (b * g);
+    out[14] = 1.0f / g;
+    out[15] = -e / (f * g);
+    return true;
+}
+
+// Everything the passes derive from the camera, computed once per camera
+// change instead of once per frame.
+struct CameraConstants {
+    float view[16], proj[16];
+    float invView[16], invProj[16];
+    float viewProj[16];
+    float prevViewProj[16];
+    float reprojection[16]; // current view space -> previous frame clip space
+    
+    // view.xy = (uv * projInfo.xy + projInfo.zw) * view.z
+    float projInfo[4];
+    // view.z = depthParams.x / (depth - depthParams.y), depth in [0,1]
+    float depthParams[2];
+    // uv covered by one view-space unit at distance 1
+    float projScale[2];
+    
+    float nearPlane, farPlane;
+    
+    bool valid;
+    bool changed; // inputs differ from the previous frame
+} camConsts;
+
+// Returns false if the matrices cannot be inverted, in which case the
+// previous constants are left untouched.
+bool UpdateCameraConstants(const float* view, const float* proj,
+                           float nearPlane, float farPlane) {
+    CameraConstants& c = camConsts;
+    
+    if(c.valid &&
+       memcmp(c.view, view, sizeof(c.view)) == 0 &&
+       memcmp(c.proj, proj, sizeof(c.proj)) == 0 &&
+       c.nearPlane == nearPlane && c.farPlane == farPlane) {
+        if(c.changed) {
+            // Camera stopped: last frame's matrices are now the previous ones
+            memcpy(c.prevViewProj, c.viewProj, sizeof(c.viewProj));
+            Mat4Mul(c.prevViewProj, c.invView, c.reprojection);
+            c.changed = false;
+        }
+        return true;
+    }
     
-    #undef RESOLVE
+    float invView[16], invProj[16];
+    if(!Mat4InvertRigid(view, invView) && !Matrix4x4Invert(view, invView)) {
+        logger->Error("View matrix is singular, keeping previous constants");
+        return false;
+    }
+    // projInfo and depthParams cannot describe an oblique near plane or an
+    // orthographic depth, so those would reconstruct the wrong view space
+    if(!Mat4InvertPerspective(proj, invProj)) {
+        logger->Error("Projection matrix is not a plain perspective, keeping previous constants");
+        return false;
+    }
     
-    logger->Info("Addresses resolved");
+    if(c.valid)
+        memcpy(c.prevViewProj, c.viewProj, sizeof(c.viewProj));
+    
+    memcpy(c.view, view, sizeof(c.view));
+    memcpy(c.proj, proj, sizeof(c.proj));
+    memcpy(c.invView, invView, sizeof(invView));
+    memcpy(c.invProj, invProj, sizeof(invProj));
+    Mat4Mul(proj, view, c.viewProj);
+    
+    if(!c.valid)
+        memcpy(c.prevViewProj, c.viewProj, sizeof(c.viewProj));
+    Mat4Mul(c.prevViewProj, invView, c.reprojection);
+    
+    // invProj maps NDC (2uv - 1, 2depth - 1) to view space with
+    //   view.xyz = (i0 * x + i12, i5 * y + i13, i14) / (i11 * z + i15)
+    // which the shader evaluates in the factored forms below
+    c.projInfo[0] = 2.0f * invProj[0] / invProj[14];
+    c.projInfo[1] = 2.0f * invProj[5] / invProj[14];
+    c.projInfo[2] = (invProj[12] - invProj[0]) / invProj[14];
+    c.projInfo[3] = (invProj[13] - invProj[5]) / invProj[14];
+    
+    c.depthParams[0] = invProj[14] / (2.0f * invProj[11]);
+    c.depthParams[1] = (invProj[11] - invProj[15]) / (2.0f * invProj[11]);
+    
+    c.projScale[0] = 0.5f * fabsf(proj[0]);
+    c.projScale[1] = 0.5f * fabsf(proj[5]);
+    
+    c.nearPlane = nearPlane;
+    c.farPlane = farPlane;
+    c.valid = true;
+    c.changed = true;
     return true;
 }
 
-bool InitShaders() {
-    logger->Info("Compiling shaders...");
+// ============================================================================
+// AO TECHNIQUES
+// ============================================================================
+
+// One AO algorithm: its program, uniforms and per-frame setup. Techniques
+// share aoCommonFragShader (inputs, reconstruction, multi-resolution
+// combine) and only supply computeAO(). The pipeline owns the targets and
+// runs the same pass list for all of them: optional coarse level, AO,
+// bilateral blur, composite.
+struct AOTechnique {
+    GLuint program = 0;
+    bool failed = false; // compile or link failed, not retried
+    AOUniforms uniforms;
+    
+    virtual ~AOTechnique() {}
+    virtual const char* Name() const = 0;
+    virtual const char* FragmentBody() const = 0;
+    
+    virtual bool Init() {
+        program = CreateProgram(aoVertShader, aoCommonFragShader, FragmentBody(), FetchPathHeader());
+        if(!program) return false;
+        
+        uniforms.depthTex = glGetUniformLocation(program, "uDepthTex");
+        uniforms.viewMatrix = glGetUniformLocation(program, "uViewMatrix");
+        uniforms.projMatrix = glGetUniformLocation(program, "uProjMatrix");
+        uniforms.invViewMatrix = glGetUniformLocation(program, "uInvViewMatrix");
+        uniforms.projInfo = glGetUniformLocation(program, "uProjInfo");
+        uniforms.depthParams = glGetUniformLocation(program, "uDepthParams");
+        uniforms.projScale = glGetUniformLocation(program, "uProjScale");
+        uniforms.screenSize = glGetUniformLocation(program, "uScreenSize");
+        uniforms.targetSize = glGetUniformLocation(program, "uTargetSize");
+        uniforms.samples = glGetUniformLocation(program, "uSamples");
+        uniforms.radius = glGetUniformLocation(program, "uRadius");
+        uniforms.density = glGetUniformLocation(program, "uDensity");
+        uniforms.coarseAOTex = glGetUniformLocation(program, "uCoarseAOTex");
+        uniforms.coarseSize = glGetUniformLocation(program, "uCoarseSize");
+        uniforms.multiRes = glGetUniformLocation(program, "uMultiRes");
+        uniforms.fusedDenoise = glGetUniformLocation(program, "uFusedDenoise");
+        uniforms.adaptiveSamples = glGetUniformLocation(program, "uAdaptiveSamples");
+        uniforms.minSamples = glGetUniformLocation(program, "uMinSamples");
+        uniforms.checkerboard = glGetUniformLocation(program, "uCheckerboard");
+        return true;
+    }
     
-    // AO shader
-    aoProgram = CreateProgram(aoVertShader, aoFragShader);
-    if(!aoProgram) return false;
-    
-    aoUniforms.depthTex = glGetUniformLocation(aoProgram, "uDepthTex");
-    aoUniforms.viewMatrix = glGetUniformLocation(aoProgram, "uViewMatrix");
-    aoUniforms.projMatrix = glGetUniformLocation(aoProgram, "uProjMatrix");
-    aoUniforms.invViewMatrix = glGetUniformLocation(aoProgram, "uInvViewMatrix");
-    aoUniforms.invProjMatrix = glGetUniformLocation(aoProgram, "uInvProjMatrix");
-    aoUniforms.nearPlane = glGetUniformLocation(aoProgram, "uNearPlane");
-    aoUniforms.farPlane = glGetUniformLocation(aoProgram, "uFarPlane");
-    aoUniforms.screenSize = glGetUniformLocation(aoProgram, "uScreenSize");
-    aoUniforms.samples = glGetUniformLocation(aoProgram, "uSamples");
-    aoUniforms.radius = glGetUniformLocation(aoProgram, "uRadius");
-    aoUniforms.density = glGetUniformLocation(aoProgram, "uDensity");
+    virtual void Shutdown() {
+        if(program) glDeleteProgram(program);
+        program = 0;
+        failed = false;
+    }
     
-    // Blur shader
-    blurProgram = CreateProgram(aoVertShader, blurFragShader);
-    if(!blurProgram) return false;
+    // Binds the program and sets everything constant across the frame's
+    // AO passes. Depth goes to texture unit 0.
+    virtual void BeginFrame(const CameraConstants& cc, int width, int height, GLuint depthTex) {
+        glUseProgram(program);
+        
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depthTex);
+        glUniform1i(uniforms.depthTex, 0);
+        
+        glUniformMatrix4fv(uniforms.viewMatrix, 1, GL_FALSE, cc.view);
+        glUniformMatrix4fv(uniforms.projMatrix, 1, GL_FALSE, cc.proj);
+        glUniformMatrix4fv(uniforms.invViewMatrix, 1, GL_FALSE, cc.invView);
+        
+        glUniform4fv(uniforms.projInfo, 1, cc.projInfo);
+        glUniform2fv(uniforms.depthParams, 1, cc.depthParams);
+        glUniform2fv(uniforms.projScale, 1, cc.projScale);
+        glUniform2f(uniforms.screenSize, (float)width, (float)height);
+        glUniform1f(uniforms.density, pDensity->GetFloat());
+        glUniform1i(uniforms.fusedDenoise, pFusedDenoise->GetBool() && fineDerivatives ? 1 : 0);
+        glUniform1i(uniforms.adaptiveSamples, pAdaptiveSamples->GetBool() ? 1 : 0);
+    }
+    
+    // One AO pass into the bound width x height target. With coarseTex set,
+    // the result is combined with that coarse level (texture unit 1). In
+    // adaptive mode samples is the per-pixel maximum. checkerboard >= 0
+    // shades only the pixels of that parity into a half-width target;
+    // width stays the full one.
+    virtual void Draw(int width, int height, int samples, float radius,
+                      GLuint coarseTex, int coarseWidth, int coarseHeight, int checkerboard) {
+        int minSamples = pMinSamples->GetInt();
+        glUniform2f(uniforms.targetSize, (float)width, (float)height);
+        glUniform1i(uniforms.checkerboard, checkerboard);
+        glUniform1f(uniforms.samples, (float)samples);
+        glUniform1f(uniforms.minSamples, (float)(minSamples < samples ? minSamples : samples));
+        glUniform1f(uniforms.radius, radius);
+        
+        if(coarseTex) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, coarseTex);
+            glUniform1i(uniforms.coarseAOTex, 1);
+            glUniform2f(uniforms.coarseSize, (float)coarseWidth, (float)coarseHeight);
+            glUniform1i(uniforms.multiRes, 1);
+        } else {
+            glUniform1i(uniforms.coarseAOTex, 0); // never the bound render target
+            glUniform1i(uniforms.multiRes, 0);
+        }
+        
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+};
+
+struct SAOTechnique : AOTechnique {
+    const char* Name() const override { return "SAO"; }
+    const char* FragmentBody() const override { return saoFragShader; }
+} saoTechnique;
+
+struct HBAOTechnique : AOTechnique {
+    const char* Name() const override { return "HBAO"; }
+    const char* FragmentBody() const override { return hbaoFragShader; }
+} hbaoTechnique;
+
+struct GTAOTechnique : AOTechnique {
+    const char* Name() const override { return "GTAO"; }
+    const char* FragmentBody() const override { return gtaoFragShader; }
+} gtaoTechnique;
+
+AOTechnique* aoTechniques[] = { &saoTechnique, &hbaoTechnique, &gtaoTechnique };
+
+// Compiles the technique on first use. A failure is logged once and
+// remembered, so a broken shader is not recompiled every frame.
+bool EnsureAOTechnique(AOTechnique* technique) {
+    if(technique->program) return true;
+    if(technique->failed) return false;
+    
+    if(!technique->Init()) {
+        logger->Error("Failed to compile AO technique %s", technique->Name());
+        technique->failed = true;
+        return false;
+    }
+    return true;
+}
+
+// Looks up a technique by name (case-insensitive) and compiles it on first
+// use. Unknown names and techniques that fail to compile fall back to SAO.
+AOTechnique* SelectAOTechnique(const char* name) {
+    AOTechnique* technique = &saoTechnique;
+    for(AOTechnique* t : aoTechniques) {
+        if(strcasecmp(t->Name(), name) == 0) {
+            technique = t;
+            break;
+        }
+    }
+    
+    if(EnsureAOTechnique(technique)) return technique;
+    if(technique != &saoTechnique && EnsureAOTechnique(&saoTechnique)) return &saoTechnique;
+    return nullptr;
+}
+
+// ============================================================================
+// INITIALIZATION
+// ============================================================================
+
+bool InitAddresses() {
+    logger->Info("Resolving addresses...");
+    
+    void* lib = dlopen("libGTASA.so", RTLD_NOW);
+    if(!lib) {
+        logger->Error("Failed to load libGTASA.so");
+        return false;
+    }
+    
+    #define RESOLVE(name, offset) \
+        name = (decltype(name))((uintptr_t)lib + offset); \
+        if(!name) logger->Error("Failed to resolve " #name);
+    
+    RESOLVE(_rwCameraValRender_orig, 0x001d7140);
+    RESOLVE(GetCurrentViewMatrix, 0x001ba6e0);
+    RESOLVE(GetCurrentProjectionMatrix, 0x001ba6f8);
+    RESOLVE(SetupScreenSpaceProjection, 0x001ada2c);
+    RESOLVE(RwRasterLock, 0x001daaf4);
+    RESOLVE(RwRasterUnlock, 0x001da738);
+    RESOLVE(RwRasterCreate, 0x001daa50);
+    RESOLVE(RwRasterDestroy, 0x001da850);
+    RESOLVE(RwMatrixInvert, 0x001e3a28);
+    RESOLVE(RwV3dTransformPoint, 0x001e698c);
+    RESOLVE(_rwOpenGLGetEngineZBufferDepth, 0x001b13bc);
+    RESOLVE(RwRasterShowRaster, 0x001da9bc);
+    
+    g_pZBuffer = (RwRaster**)((uintptr_t)lib + 0x00a5a138);
+    g_rwRaster_cpPixels = (unsigned char**)((uintptr_t)lib + 0x0067a044);
+    g_TheCamera = (void*)((uintptr_t)lib + 0x00951fa8);
+    
+    #undef RESOLVE
+    
+    logger->Info("Addresses resolved");
+    return true;
+}
+
+// Draws derivativeProbeFragShader into a 2x2 target and checks that the
+// two rows saw their own slope. Any failure counts as coarse.
+bool ProbeFineDerivatives() {
+    GLuint program = CreateProgram(derivativeProbeVertShader, derivativeProbeFragShader);
+    if(!program) return false;
+    
+    GLint lastFBO, lastViewport[4], lastVAO;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &lastFBO);
+    glGetIntegerv(GL_VIEWPORT, lastViewport);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &lastVAO);
+    
+    GLuint texture, fbo;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 2, 2);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    
+    unsigned char pixels[2 * 2 * 4] = {};
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+        glViewport(0, 0, 2, 2);
+        glBindVertexArray(0);
+        glUseProgram(program);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glReadPixels(0, 0, 2, 2, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)lastFBO);
+    glViewport(lastViewport[0], lastViewport[1], lastViewport[2], lastViewport[3]);
+    glBindVertexArray((GLuint)lastVAO);
+    glUseProgram(0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &texture);
+    glDeleteProgram(program);
+    
+    // 0.25 and 0.75 in the red channel, one row each
+    int row0 = pixels[0], row1 = pixels[2 * 4];
+    return abs(row0 - 64) <= 2 && abs(row1 - 191) <= 2;
+}
+
+bool InitShaders() {
+    logger->Info("Compiling shaders...");
+    
+    // textureGather (and GLSL ES 3.10) needs a GLES 3.1 context
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    textureGatherPath = pTextureGather->GetBool() && (major > 3 || (major == 3 && minor >= 1));
+    logger->Info("GLES %d.%d, %s fetch path", major, minor,
+                 textureGatherPath ? "textureGather" : "texture");
+    
+    // AO shader of the configured technique, others compile on demand
+    if(!SelectAOTechnique(pTechnique->GetString())) return false;
+    
+    // Blur shader
+    blurProgram = CreateProgram(aoVertShader, blurFragShader, nullptr, FetchPathHeader());
+    if(!blurProgram) return false;
     
     blurUniforms.aoTex = glGetUniformLocation(blurProgram, "uAOTex");
     blurUniforms.depthTex = glGetUniformLocation(blurProgram, "uDepthTex");
     blurUniforms.direction = glGetUniformLocation(blurProgram, "uDirection");
     blurUniforms.radius = glGetUniformLocation(blurProgram, "uRadius");
     blurUniforms.screenSize = glGetUniformLocation(blurProgram, "uScreenSize");
+    blurUniforms.depthAligned = glGetUniformLocation(blurProgram, "uDepthAligned");
+    blurUniforms.weights = glGetUniformLocation(blurProgram, "uWeights");
+    blurUniforms.linearTaps = glGetUniformLocation(blurProgram, "uLinearTaps");
+    blurUniforms.linearTapCount = glGetUniformLocation(blurProgram, "uLinearTapCount");
     
     // Composite shader
     compositeProgram = CreateProgram(aoVertShader, compositeFragShader);
@@ -623,6 +1625,38 @@ bool InitShaders() {
     compositeUniforms.aoTex = glGetUniformLocation(compositeProgram, "uAOTex");
     compositeUniforms.debugMode = glGetUniformLocation(compositeProgram, "uDebugMode");
     
+    // Sky mask shader, depth always on unit 0
+    skyMaskProgram = CreateProgram(aoVertShader, skyMaskFragShader);
+    if(!skyMaskProgram) return false;
+    
+    skyMaskUniforms.screenSize = glGetUniformLocation(skyMaskProgram, "uScreenSize");
+    skyMaskUniforms.checkerboard = glGetUniformLocation(skyMaskProgram, "uCheckerboard");
+    
+    glUseProgram(skyMaskProgram);
+    glUniform1i(glGetUniformLocation(skyMaskProgram, "uDepthTex"), 0);
+    
+    // Checkerboard reconstruction: shaded AO, depth and history on units 0-2
+    checkerboardProgram = CreateProgram(aoVertShader, checkerboardFragShader);
+    if(!checkerboardProgram) return false;
+    
+    checkerboardUniforms.reprojection = glGetUniformLocation(checkerboardProgram, "uReprojection");
+    checkerboardUniforms.projInfo = glGetUniformLocation(checkerboardProgram, "uProjInfo");
+    checkerboardUniforms.depthParams = glGetUniformLocation(checkerboardProgram, "uDepthParams");
+    checkerboardUniforms.projW = glGetUniformLocation(checkerboardProgram, "uProjW");
+    checkerboardUniforms.screenSize = glGetUniformLocation(checkerboardProgram, "uScreenSize");
+    checkerboardUniforms.parity = glGetUniformLocation(checkerboardProgram, "uParity");
+    checkerboardUniforms.historyValid = glGetUniformLocation(checkerboardProgram, "uHistoryValid");
+    
+    glUseProgram(checkerboardProgram);
+    glUniform1i(glGetUniformLocation(checkerboardProgram, "uAOTex"), 0);
+    glUniform1i(glGetUniformLocation(checkerboardProgram, "uDepthTex"), 1);
+    glUniform1i(glGetUniformLocation(checkerboardProgram, "uHistoryTex"), 2);
+    glUseProgram(0);
+    
+    fineDerivatives = ProbeFineDerivatives();
+    if(!fineDerivatives)
+        logger->Info("Coarse shader derivatives, FusedDenoise falls back to the blur passes");
+    
     logger->Info("Shaders compiled");
     return true;
 }
@@ -647,55 +1681,6 @@ bool InitGeometry() {
     return true;
 }
 
-bool InitRenderTargets(int width, int height) {
-    // Apply resolution scale
-    float scale = pResolutionScale->GetFloat();
-    int aoWidth = (int)(width * scale);
-    int aoHeight = (int)(height * scale);
-    
-    logger->Info("Creating render targets: scene=%dx%d, AO=%dx%d", 
-                 width, height, aoWidth, aoHeight);
-    
-    // Create textures
-    auto CreateTexture = [](GLuint& tex, int w, int h, GLint format, GLenum type) {
-        glGenTextures(1, &tex);
-        glBindTexture(GL_TEXTURE_2D, tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, 
-                     (format == GL_RGBA8) ? GL_RGBA : GL_RED, type, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    };
-    
-    CreateTexture(aoTexture, aoWidth, aoHeight, GL_R16F, GL_FLOAT);
-    CreateTexture(blurTexture, aoWidth, aoHeight, GL_R16F, GL_FLOAT);
-    CreateTexture(sceneTexture, width, height, GL_RGBA8, GL_UNSIGNED_BYTE);
-    
-    // Create FBOs
-    auto CreateFBO = [](GLuint& fbo, GLuint colorTex) {
-        glGenFramebuffers(1, &fbo);
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 
-                              GL_TEXTURE_2D, colorTex, 0);
-        
-        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            logger->Error("Framebuffer incomplete!");
-            return false;
-        }
-        return true;
-    };
-    
-    if(!CreateFBO(aoFBO, aoTexture)) return false;
-    if(!CreateFBO(blurFBO, blurTexture)) return false;
-    if(!CreateFBO(compositeFBO, sceneTexture)) return false;
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    
-    logger->Info("Render targets created");
-    return true;
-}
-
 bool InitSSAO() {
     logger->Info("Initializing Complete SSAO...");
     
@@ -707,47 +1692,45 @@ bool InitSSAO() {
     return true;
 }
 
+// ============================================================================
+// FRAME INPUT
+// ============================================================================
+
+// Everything one SSAO frame consumes. Filled from the game in RenderSSAO,
+// or from a capture file by the desktop replay tool.
+struct SSAOFrameInput {
+    const void* depthPixels;
+    int depthWidth, depthHeight;
+    int depthBits;
+    const float* viewMatrix;
+    const float* projMatrix;
+    float nearPlane, farPlane;
+    int width, height; // color buffer
+};
+
 // ============================================================================
 // DEPTH EXTRACTION
 // ============================================================================
 
-GLuint ExtractDepthTexture(RwRaster* zBuffer) {
-    if(!zBuffer || !zBuffer->pixels) {
-        logger->Error("Invalid Z-buffer");
-        return 0;
-    }
-    
+GLuint UploadDepthTexture(const void* pixels, int width, int height, int depthBits) {
     GLuint tex;
     glGenTextures(1, &tex);
     glBindTexture(GL_TEXTURE_2D, tex);
     
-    // Lock raster to get pixel data
-    if(RwRasterLock) {
-        RwRasterLock(zBuffer, 0, 2); // RASTER_LOCK_READ
-    }
-    
     // Determine format
-    GLenum format = GL_DEPTH_COMPONENT;
+    GLenum internalFormat = GL_DEPTH_COMPONENT24;
     GLenum type = GL_UNSIGNED_INT;
     
-    if(zBuffer->depth == 24) {
-        format = GL_DEPTH_COMPONENT;
-        type = GL_UNSIGNED_INT;
-    } else if(zBuffer->depth == 16) {
-        format = GL_DEPTH_COMPONENT;
+    if(depthBits == 16) {
+        internalFormat = GL_DEPTH_COMPONENT16;
         type = GL_UNSIGNED_SHORT;
-    } else if(zBuffer->depth == 32) {
-        format = GL_DEPTH_COMPONENT;
+    } else if(depthBits == 32) {
+        internalFormat = GL_DEPTH_COMPONENT32F;
         type = GL_FLOAT;
     }
     
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, 
-                 zBuffer->width, zBuffer->height, 
-                 0, format, type, zBuffer->pixels);
-    
-    if(RwRasterUnlock) {
-        RwRasterUnlock(zBuffer);
-    }
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height,
+                 0, GL_DEPTH_COMPONENT, type, pixels);
     
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -761,168 +1744,951 @@ GLuint ExtractDepthTexture(RwRaster* zBuffer) {
 // SCENE CAPTURE
 // ============================================================================
 
-void CaptureSceneTexture(RwRaster* frameBuffer) {
-    if(!frameBuffer) return;
-    
-    // Read framebuffer into texture
-    glBindTexture(GL_TEXTURE_2D, sceneTexture);
-    glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 
-                     0, 0, frameBuffer->width, frameBuffer->height, 0);
+// Copies the game's framebuffer into the bound RGBA8 scene texture
+void CaptureSceneTexture(GLuint sourceFBO, int width, int height) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFBO);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
 }
 
 // ============================================================================
-// MAIN RENDERING
+// FRAME CAPTURE
 // ============================================================================
 
-void RenderSSAO(RwCamera* camera) {
-    if(!pEnabled->GetBool()) return;
-    if(!camera || !camera->bufferColor) return;
+SSAOCaptureWriter captureWriter;
+bool captureDone = false;
+
+void BuildConfigSnapshot(char* out, size_t size) {
+    snprintf(out, size,
+             "Samples=%d;Radius=%g;Density=%g;BlurEnabled=%d;BlurRadius=%d;"
+             "ResolutionScale=%g;Checkerboard=%d;AmortizeRegions=%d;MultiResolution=%d;CoarseScale=%g;"
+             "CoarseSamples=%d;CoarseRadius=%g;Technique=%s;FusedDenoise=%d;"
+             "SkyStencil=%d;AdaptiveSamples=%d;MinSamples=%d;Preset=%s",
+             pSamples->GetInt(), pRadius->GetFloat(), pDensity->GetFloat(),
+             pBlurEnabled->GetBool() ? 1 : 0, pBlurRadius->GetInt(),
+             pResolutionScale->GetFloat(), pCheckerboard->GetBool() ? 1 : 0, pAmortizeRegions->GetInt(),
+             pMultiRes->GetBool() ? 1 : 0, pCoarseScale->GetFloat(), pCoarseSamples->GetInt(),
+             pCoarseRadius->GetFloat(), pTechnique->GetString(),
+             pFusedDenoise->GetBool() ? 1 : 0, pSkyStencil->GetBool() ? 1 : 0,
+             pAdaptiveSamples->GetBool() ? 1 : 0, pMinSamples->GetInt(), pPreset->GetString());
+}
+
+// Appends the raw inputs of this frame to the capture file until
+// CaptureFrames frames have been written
+void CaptureFrame(const SSAOFrameInput& in) {
+    int frames = pCaptureFrames->GetInt();
+    if(frames <= 0 || captureDone) return;
     
-    RwRaster* frameBuffer = camera->bufferColor;
-    RwRaster* zBuffer = (g_pZBuffer && *g_pZBuffer) ? *g_pZBuffer : camera->bufferDepth;
+    if(!captureWriter.file) {
+        char config[sizeof(SSAOCaptureHeader::config)];
+        BuildConfigSnapshot(config, sizeof(config));
+        
+        if(!captureWriter.Open(pCapturePath->GetString(), config)) {
+            logger->Error("Failed to open capture file %s", pCapturePath->GetString());
+            captureDone = true;
+            return;
+        }
+        logger->Info("Capturing %d frames to %s", frames, pCapturePath->GetString());
+    }
     
-    if(!zBuffer) {
-        logger->Error("No Z-buffer available");
-        return;
+    SSAOCaptureFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.width = in.depthWidth;
+    frame.height = in.depthHeight;
+    frame.depthBits = in.depthBits;
+    memcpy(frame.viewMatrix, in.viewMatrix, sizeof(frame.viewMatrix));
+    memcpy(frame.projMatrix, in.projMatrix, sizeof(frame.projMatrix));
+    frame.nearPlane = in.nearPlane;
+    frame.farPlane = in.farPlane;
+    frame.targetWidth = in.width;
+    frame.targetHeight = in.height;
+    
+    bool ok = captureWriter.WriteFrame(frame, in.depthPixels, pCaptureCompress->GetBool());
+    if(!ok || (int)captureWriter.frameCount >= frames) {
+        if(!ok) logger->Error("Capture write failed, stopping");
+        logger->Info("Capture finished: %u frames", captureWriter.frameCount);
+        captureWriter.Close();
+        captureDone = true;
     }
+}
+
+// ============================================================================
+// STATIC FRAME DETECTION
+// ============================================================================
+
+#define SSAO_HASH_GRID 64
+
+// FNV-1a over a 64x64 grid of Z-raster texels plus the raster layout.
+// Enough to notice moving peds, cars and doors without reading the
+// whole buffer every frame.
+uint32_t HashDepthSamples(const void* pixels, int width, int height, int depthBits) {
+    const unsigned char* bytes = (const unsigned char*)pixels;
+    size_t texelSize = depthBits == 16 ? 2 : 4;
     
-    int width = frameBuffer->width;
-    int height = frameBuffer->height;
+    uint32_t hash = 2166136261u;
+    auto Mix = [&hash](const unsigned char* p, size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            hash ^= p[i];
+            hash *= 16777619u;
+        }
+    };
     
-    float scale = pResolutionScale->GetFloat();
-    int aoWidth = (int)(width * scale);
-    int aoHeight = (int)(height * scale);
+    int layout[3] = { width, height, depthBits };
+    Mix((const unsigned char*)layout, sizeof(layout));
     
-    // Recreate render targets if resolution changed
-    static int lastWidth = 0, lastHeight = 0;
-    if(width != lastWidth || height != lastHeight) {
-        if(aoTexture) glDeleteTextures(1, &aoTexture);
-        if(blurTexture) glDeleteTextures(1, &blurTexture);
-        if(sceneTexture) glDeleteTextures(1, &sceneTexture);
-        if(aoFBO) glDeleteFramebuffers(1, &aoFBO);
-        if(blurFBO) glDeleteFramebuffers(1, &blurFBO);
-        if(compositeFBO) glDeleteFramebuffers(1, &compositeFBO);
+    for(int gy = 0; gy < SSAO_HASH_GRID; gy++) {
+        // Odd multiples of half a cell, so samples avoid the raster borders
+        int y = (2 * gy + 1) * height / (2 * SSAO_HASH_GRID);
+        const unsigned char* row = bytes + (size_t)y * width * texelSize;
+        for(int gx = 0; gx < SSAO_HASH_GRID; gx++) {
+            int x = (2 * gx + 1) * width / (2 * SSAO_HASH_GRID);
+            Mix(row + (size_t)x * texelSize, texelSize);
+        }
+    }
+    return hash;
+}
+
+// Decides whether aoTexture still holds this frame's AO: same camera,
+// same sampled Z-raster, same settings as the last computed frame.
+struct StaticFrameDetector {
+    bool valid = false;
+    uint32_t depthHash = 0;
+    char config[sizeof(SSAOCaptureHeader::config)] = {};
+    int reusedFrames = 0;
+    
+    bool Unchanged(const SSAOFrameInput& in, bool cameraChanged) {
+        char snapshot[sizeof(config)];
+        BuildConfigSnapshot(snapshot, sizeof(snapshot));
+        uint32_t hash = HashDepthSamples(in.depthPixels, in.depthWidth, in.depthHeight, in.depthBits);
         
-        if(!InitRenderTargets(width, height)) return;
+        // StaticRefresh bounds how long changes between grid samples can go unseen
+        int refresh = pStaticRefresh->GetInt();
+        bool unchanged = valid && !cameraChanged && hash == depthHash &&
+                         strcmp(snapshot, config) == 0 &&
+                         (refresh <= 0 || reusedFrames < refresh);
         
-        lastWidth = width;
-        lastHeight = height;
+        if(unchanged) {
+            reusedFrames++;
+        } else {
+            depthHash = hash;
+            memcpy(config, snapshot, sizeof(config));
+            reusedFrames = 0;
+            valid = true;
+        }
+        return unchanged;
     }
     
-    // Step 1: Capture scene
-    CaptureSceneTexture(frameBuffer);
-    
-    // Step 2: Extract depth
-    if(depthTexture) glDeleteTextures(1, &depthTexture);
-    depthTexture = ExtractDepthTexture(zBuffer);
-    if(!depthTexture) return;
-    
-    // Step 3: Get matrices
-    float* viewMat = GetCurrentViewMatrix();
-    float* projMat = GetCurrentProjectionMatrix();
-    
-    if(!viewMat || !projMat) {
-        logger->Error("Failed to get matrices");
-        return;
+    // The next frame must be computed (targets recreated, frame dropped)
+    void Invalidate() {
+        valid = false;
+    }
+} staticFrame;
+
+// ============================================================================
+// AMORTIZED UPDATE
+// ============================================================================
+
+#define SSAO_AMORTIZE_MAX_REGIONS 8
+#define SSAO_AMORTIZE_GRID 32 // Z-raster samples per row and rows per screen
+
+// Relative view-depth change that counts a sample as moved
+#define SSAO_AMORTIZE_DEPTH_TOLERANCE 0.02f
+// How much a fully changed band outranks an unchanged one of the same age
+#define SSAO_AMORTIZE_CHANGE_WEIGHT 4.0f
+// A scene cut changes this share of all samples by more than the cut
+// tolerance from one frame to the next; camera motion at any playable
+// speed moves a sample by a few percent per frame
+#define SSAO_AMORTIZE_CUT_FRACTION 0.5f
+#define SSAO_AMORTIZE_CUT_TOLERANCE 0.25f
+
+// View depth of one Z-raster texel, see CameraConstants::depthParams
+float RasterViewDepth(const unsigned char* texel, int depthBits, const float depthParams[2]) {
+    float depth;
+    if(depthBits == 16) {
+        uint16_t v;
+        memcpy(&v, texel, sizeof(v));
+        depth = v / 65535.0f;
+    } else if(depthBits == 32) {
+        memcpy(&depth, texel, sizeof(depth));
+    } else {
+        uint32_t v;
+        memcpy(&v, texel, sizeof(v));
+        depth = (float)(v / 4294967295.0);
+    }
+    return depthParams[0] / (depth - depthParams[1]);
+}
+
+// Picks the horizontal band of the AO target to recompute this frame.
+// Each band remembers a grid of view depths from its last update; a band
+// whose samples moved since then (geometry or camera) outranks one that
+// is merely old, and among moved bands the oldest goes first, so camera
+// motion refreshes the screen in one cycle of bands. After a scene cut
+// the old bands would show another place for several frames, so the
+// whole target is recomputed, at most once per cycle of bands.
+struct AmortizedScheduler {
+    bool valid = false;
+    int regions = 0;
+    int width = 0, height = 0;
+    float depth[SSAO_AMORTIZE_GRID * SSAO_AMORTIZE_GRID];    // per band, at its last update
+    float previous[SSAO_AMORTIZE_GRID * SSAO_AMORTIZE_GRID]; // the previous frame
+    int sinceRestart = 0; // frames since the last full recompute
+    int age[SSAO_AMORTIZE_MAX_REGIONS];
+    bool stale[SSAO_AMORTIZE_MAX_REGIONS]; // inputs changed since the last update
+    char config[sizeof(SSAOCaptureHeader::config)] = {};
+    
+    // Band of grid row gy, from the row's position on screen
+    int RegionOfRow(int gy) const {
+        return (2 * gy + 1) * regions / (2 * SSAO_AMORTIZE_GRID);
     }
     
-    // Convert to GL format if needed
-    float viewMatGL[16], projMatGL[16];
-    memcpy(viewMatGL, viewMat, 16 * sizeof(float));
-    memcpy(projMatGL, projMat, 16 * sizeof(float));
+    // Returns the band to recompute, or -1 when the whole target must be:
+    // no history of this size yet, a different band count or a scene cut
+    int Schedule(const SSAOFrameInput& in, const CameraConstants& cc,
+                 int count, int aoWidth, int aoHeight, bool historyValid) {
+        char snapshot[sizeof(config)];
+        BuildConfigSnapshot(snapshot, sizeof(snapshot));
+        bool configChanged = strcmp(snapshot, config) != 0;
+        memcpy(config, snapshot, sizeof(config));
+        
+        float current[SSAO_AMORTIZE_GRID * SSAO_AMORTIZE_GRID];
+        const unsigned char* bytes = (const unsigned char*)in.depthPixels;
+        size_t texelSize = in.depthBits == 16 ? 2 : 4;
+        for(int gy = 0; gy < SSAO_AMORTIZE_GRID; gy++) {
+            int y = (2 * gy + 1) * in.depthHeight / (2 * SSAO_AMORTIZE_GRID);
+            const unsigned char* row = bytes + (size_t)y * in.depthWidth * texelSize;
+            for(int gx = 0; gx < SSAO_AMORTIZE_GRID; gx++) {
+                int x = (2 * gx + 1) * in.depthWidth / (2 * SSAO_AMORTIZE_GRID);
+                float z = RasterViewDepth(row + (size_t)x * texelSize, in.depthBits, cc.depthParams);
+                current[gy * SSAO_AMORTIZE_GRID + gx] = z;
+            }
+        }
+        
+        bool restart = !valid || !historyValid || count != regions || aoWidth != width || aoHeight != height;
+        
+        // Samples of each band that moved since its update, and samples
+        // that changed like in a cut since the previous frame
+        int moved[SSAO_AMORTIZE_MAX_REGIONS] = {};
+        int samples[SSAO_AMORTIZE_MAX_REGIONS] = {};
+        int changed = 0;
+        if(!restart) {
+            for(int gy = 0; gy < SSAO_AMORTIZE_GRID; gy++) {
+                int r = RegionOfRow(gy);
+                for(int gx = 0; gx < SSAO_AMORTIZE_GRID; gx++) {
+                    int i = gy * SSAO_AMORTIZE_GRID + gx;
+                    if(fabsf(current[i] - depth[i]) > SSAO_AMORTIZE_DEPTH_TOLERANCE * fabsf(depth[i]))
+                        moved[r]++;
+                    if(fabsf(current[i] - previous[i]) > SSAO_AMORTIZE_CUT_TOLERANCE * fabsf(previous[i]))
+                        changed++;
+                    samples[r]++;
+                }
+            }
+        }
+        memcpy(previous, current, sizeof(previous));
+        
+        // A cut within one cycle of the last full recompute is left to the
+        // bands, so a run of cuts adds at most one full frame per cycle
+        bool cut = changed > SSAO_AMORTIZE_CUT_FRACTION * SSAO_AMORTIZE_GRID * SSAO_AMORTIZE_GRID &&
+                   sinceRestart >= regions;
+        
+        if(restart || cut) {
+            valid = true;
+            regions = count;
+            width = aoWidth;
+            height = aoHeight;
+            sinceRestart = 0;
+            memcpy(depth, current, sizeof(depth));
+            for(int r = 0; r < regions; r++) {
+                age[r] = 0;
+                stale[r] = false;
+            }
+            return -1;
+        }
+        sinceRestart++;
+        
+        int best = 0;
+        float bestPriority = -1.0f;
+        for(int r = 0; r < regions; r++) {
+            if(configChanged || cc.changed || moved[r]) stale[r] = true;
+            
+            float change = samples[r] ? (float)moved[r] / samples[r] : 0.0f;
+            float priority = (age[r] + 1) * (1.0f + SSAO_AMORTIZE_CHANGE_WEIGHT * change);
+            if(priority > bestPriority) {
+                bestPriority = priority;
+                best = r;
+            }
+        }
+        
+        for(int r = 0; r < regions; r++) age[r]++;
+        age[best] = 0;
+        stale[best] = false;
+        for(int gy = 0; gy < SSAO_AMORTIZE_GRID; gy++) {
+            if(RegionOfRow(gy) != best) continue;
+            memcpy(&depth[gy * SSAO_AMORTIZE_GRID], &current[gy * SSAO_AMORTIZE_GRID],
+                   SSAO_AMORTIZE_GRID * sizeof(float));
+        }
+        return best;
+    }
     
-    // Invert matrices
-    float invViewMat[16], invProjMat[16];
-    Matrix4x4Invert(viewMatGL, invViewMat);
-    Matrix4x4Invert(projMatGL, invProjMat);
+    // Every band was recomputed since its inputs last changed
+    bool Settled() const {
+        if(!valid) return false;
+        for(int r = 0; r < regions; r++)
+            if(stale[r]) return false;
+        return true;
+    }
     
-    // Get camera properties
-    float nearPlane = camera->nearplane;
-    float farPlane = camera->farplane;
+    // Rows [y0, y1) of band r in a target of the given height
+    void Rows(int r, int targetHeight, int& y0, int& y1) const {
+        y0 = r * targetHeight / regions;
+        y1 = (r + 1) * targetHeight / regions;
+    }
     
-    // Save GL state
-    GLint lastFBO, lastViewport[4];
-    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &lastFBO);
-    glGetIntegerv(GL_VIEWPORT, lastViewport);
+    void Invalidate() {
+        valid = false;
+    }
+} amortizer;
+
+// ============================================================================
+// GL TRACE
+// ============================================================================
+
+bool traceDone = false;
+int traceDepth = 0;
+
+// Starts a traced frame while fewer than TraceFrames have been traced.
+// Nested calls (the hook around RenderSSAOFrame) fold into the outermost,
+// so the game measures the whole hook and the desktop tools the frame.
+void BeginTraceFrame() {
+    if(traceDepth++ > 0) return;
+    int frames = pTraceFrames->GetInt();
+    if(frames <= 0 || traceDone) return;
+
+#ifdef SSAO_GL_TRACE
+    if(!ssaoGLTrace.file) {
+        if(!ssaoGLTrace.Open(pTracePath->GetString())) {
+            logger->Error("Failed to open trace file %s", pTracePath->GetString());
+            traceDone = true;
+            return;
+        }
+        logger->Info("Tracing GL calls for %d frames to %s", frames, pTracePath->GetString());
+    }
+    ssaoGLTrace.BeginFrame();
+#else
+    logger->Error("TraceFrames needs a build with SSAO_GL_TRACE");
+    traceDone = true;
+#endif
+}
+
+void EndTraceFrame() {
+    if(--traceDepth > 0) return;
+
+#ifdef SSAO_GL_TRACE
+    if(!ssaoGLTrace.inFrame) return;
+    ssaoGLTrace.EndFrame();
+    
+    const SSAOTraceFrameStats& f = ssaoGLTrace.frame;
+    logger->Info("Trace frame %u: %.3f ms CPU (%.3f ms in GL), %u calls, %u redundant binds, "
+                 "%u redundant uniforms, %u stalling queries",
+                 ssaoGLTrace.total.frames, f.cpuMs, f.glMs, f.calls,
+                 f.redundantBinds, f.redundantUniforms, f.stalls);
+    
+    if((int)ssaoGLTrace.total.frames >= pTraceFrames->GetInt()) {
+        for(int i = 0; i < SSAO_CALL_COUNT; i++) {
+            const SSAOTraceCallStats& c = ssaoGLTrace.perCall[i];
+            if(!c.calls) continue;
+            logger->Info("  %-26s %6u calls %6u redundant %8.3f ms%s", SSAOGLTracer::CallName(i),
+                         c.calls, c.redundant, c.ms, SSAOGLTracer::CallStalls(i) ? "  (stalls)" : "");
+        }
+        ssaoGLTrace.Close();
+        traceDone = true;
+        logger->Info("Trace finished: %u frames", ssaoGLTrace.total.frames);
+    }
+#endif
+}
+
+struct TraceFrameScope {
+    TraceFrameScope() { BeginTraceFrame(); }
+    ~TraceFrameScope() { EndTraceFrame(); }
+};
+
+// ============================================================================
+// MAIN RENDERING
+// ============================================================================
+
+// Called at the start of every pass and once at the end of the frame.
+// Unset in game; the desktop tools use it for per-pass timing.
+void (*ssaoPassHook)(const char* pass) = nullptr;
+
+// Pass boundary for the tracer and ssaoPassHook
+void MarkPass(const char* pass) {
+#ifdef SSAO_GL_TRACE
+    ssaoGLTrace.Pass(pass);
+#endif
+    if(ssaoPassHook) ssaoPassHook(pass);
+}
+
+#define SSAO_PASS(name) MarkPass(name)
+
+#define SSAO_BLUR_MAX_RADIUS 8 // BLUR_MAX_RADIUS in blurFragShader
+
+// Gaussian weights (sigma^2 = 2) for the bound blur program, plus the
+// same kernel folded into bilinear taps: texels i and i+1 become one
+// fetch at the weight-centred offset carrying both weights.
+int SetBlurKernel(int radius) {
+    if(radius < 1) radius = 1;
+    if(radius > SSAO_BLUR_MAX_RADIUS) radius = SSAO_BLUR_MAX_RADIUS;
+    
+    float weights[SSAO_BLUR_MAX_RADIUS + 1] = {};
+    for(int i = 0; i <= radius; i++)
+        weights[i] = expf(-(float)(i * i) * 0.25f);
+    
+    float taps[(SSAO_BLUR_MAX_RADIUS + 1) / 2][2];
+    int tapCount = 0;
+    for(int i = 1; i <= radius; i += 2) {
+        float w0 = weights[i];
+        float w1 = i + 1 <= radius ? weights[i + 1] : 0.0f;
+        taps[tapCount][0] = (i * w0 + (i + 1) * w1) / (w0 + w1);
+        taps[tapCount][1] = w0 + w1;
+        tapCount++;
+    }
     
-    // === PASS 1: Compute AO ===
-    glBindFramebuffer(GL_FRAMEBUFFER, aoFBO);
-    glViewport(0, 0, aoWidth, aoHeight);
-    glClear(GL_COLOR_BUFFER_BIT);
+    glUniform1fv(blurUniforms.weights, SSAO_BLUR_MAX_RADIUS + 1, weights);
+    glUniform2fv(blurUniforms.linearTaps, tapCount, &taps[0][0]);
+    glUniform1i(blurUniforms.linearTapCount, tapCount);
+    return radius;
+}
+
+// Stencil and colour-mask state of the game that the sky mask and the
+// render graph overwrite, restored once the composite is done
+struct GLRasterState {
+    GLint stencilFunc[2], stencilRef[2], stencilValueMask[2]; // front, back
+    GLint stencilFail[2], stencilDepthFail[2], stencilDepthPass[2];
+    GLint stencilWriteMask[2];
+    GLboolean colorMask[4];
+    
+    void Save() {
+        const GLenum faces[2][7] = {
+            { GL_STENCIL_FUNC, GL_STENCIL_REF, GL_STENCIL_VALUE_MASK, GL_STENCIL_FAIL,
+              GL_STENCIL_PASS_DEPTH_FAIL, GL_STENCIL_PASS_DEPTH_PASS, GL_STENCIL_WRITEMASK },
+            { GL_STENCIL_BACK_FUNC, GL_STENCIL_BACK_REF, GL_STENCIL_BACK_VALUE_MASK, GL_STENCIL_BACK_FAIL,
+              GL_STENCIL_BACK_PASS_DEPTH_FAIL, GL_STENCIL_BACK_PASS_DEPTH_PASS, GL_STENCIL_BACK_WRITEMASK },
+        };
+        for(int f = 0; f < 2; f++) {
+            glGetIntegerv(faces[f][0], &stencilFunc[f]);
+            glGetIntegerv(faces[f][1], &stencilRef[f]);
+            glGetIntegerv(faces[f][2], &stencilValueMask[f]);
+            glGetIntegerv(faces[f][3], &stencilFail[f]);
+            glGetIntegerv(faces[f][4], &stencilDepthFail[f]);
+            glGetIntegerv(faces[f][5], &stencilDepthPass[f]);
+            glGetIntegerv(faces[f][6], &stencilWriteMask[f]);
+        }
+        glGetBooleanv(GL_COLOR_WRITEMASK, colorMask);
+    }
     
-    glUseProgram(aoProgram);
+    void Restore() const {
+        const GLenum faces[2] = { GL_FRONT, GL_BACK };
+        for(int f = 0; f < 2; f++) {
+            glStencilFuncSeparate(faces[f], (GLenum)stencilFunc[f], stencilRef[f], (GLuint)stencilValueMask[f]);
+            glStencilOpSeparate(faces[f], (GLenum)stencilFail[f], (GLenum)stencilDepthFail[f],
+                                (GLenum)stencilDepthPass[f]);
+            glStencilMaskSeparate(faces[f], (GLuint)stencilWriteMask[f]);
+        }
+        glColorMask(colorMask[0], colorMask[1], colorMask[2], colorMask[3]);
+    }
+};
+
+// Scene copy modulated by the AO into the bound framebuffer
+void DrawComposite(GLuint sceneTex, GLuint aoTex) {
+    glUseProgram(compositeProgram);
     
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, depthTexture);
-    glUniform1i(aoUniforms.depthTex, 0);
+    glBindTexture(GL_TEXTURE_2D, sceneTex);
+    glUniform1i(compositeUniforms.sceneTex, 0);
     
-    glUniformMatrix4fv(aoUniforms.viewMatrix, 1, GL_FALSE, viewMatGL);
-    glUniformMatrix4fv(aoUniforms.projMatrix, 1, GL_FALSE, projMatGL);
-    glUniformMatrix4fv(aoUniforms.invViewMatrix, 1, GL_FALSE, invViewMat);
-    glUniformMatrix4fv(aoUniforms.invProjMatrix, 1, GL_FALSE, invProjMat);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, aoTex);
+    glUniform1i(compositeUniforms.aoTex, 1);
     
-    glUniform1f(aoUniforms.nearPlane, nearPlane);
-    glUniform1f(aoUniforms.farPlane, farPlane);
-    glUniform2f(aoUniforms.screenSize, (float)width, (float)height);
-    glUniform1f(aoUniforms.samples, (float)pSamples->GetInt());
-    glUniform1f(aoUniforms.radius, pRadius->GetFloat());
-    glUniform1f(aoUniforms.density, pDensity->GetFloat());
+    glUniform1i(compositeUniforms.debugMode, pDebugMode->GetInt());
     
-    glBindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+// Drops the AO carried between frames (static reuse, checkerboard and
+// amortized history), e.g. before rendering an unrelated scene
+void ResetFrameHistory() {
+    staticFrame.Invalidate();
+    checkerboardHistory = 0;
+    amortizedHistory = 0;
+    amortizer.Invalidate();
+}
+
+void RenderSSAOFrame(const SSAOFrameInput& in) {
+    TraceFrameScope trace;
     
-    // === PASS 2: Bilateral Blur ===
-    if(pBlurEnabled->GetBool()) {
-        glUseProgram(blurProgram);
-        
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthTexture);
-        glUniform1i(blurUniforms.depthTex, 1);
-        glUniform1f(blurUniforms.radius, (float)pBlurRadius->GetInt());
-        glUniform2f(blurUniforms.screenSize, (float)aoWidth, (float)aoHeight);
-        
-        // Horizontal pass
-        glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, aoTexture);
-        glUniform1i(blurUniforms.aoTex, 0);
-        glUniform1i(blurUniforms.direction, 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        
-        // Vertical pass
-        glBindFramebuffer(GL_FRAMEBUFFER, aoFBO);
-        glBindTexture(GL_TEXTURE_2D, blurTexture);
-        glUniform1i(blurUniforms.direction, 1);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    int width = in.width;
+    int height = in.height;
+    
+    // Checkerboard AO is full resolution, the AO pass shades half of it
+    bool checkerboard = pCheckerboard->GetBool();
+    float scale = checkerboard ? 1.0f : pResolutionScale->GetFloat();
+    int aoWidth = (int)(width * scale);
+    int aoHeight = (int)(height * scale);
+    int shadeWidth = checkerboard ? (aoWidth + 1) / 2 : aoWidth;
+    int regions = checkerboard ? 1 : pAmortizeRegions->GetInt();
+    if(regions > SSAO_AMORTIZE_MAX_REGIONS) regions = SSAO_AMORTIZE_MAX_REGIONS;
+    bool amortize = regions > 1;
+    float coarseScale = pCoarseScale->GetFloat();
+    int coarseWidth = (int)(width * coarseScale);
+    int coarseHeight = (int)(height * coarseScale);
+    
+    // Last frame's AO belongs to another output size
+    static int lastWidth = 0, lastHeight = 0;
+    if(width != lastWidth || height != lastHeight) {
+        ResetFrameHistory();
+        lastWidth = width;
+        lastHeight = height;
     }
     
-    // === PASS 3: Composite ===
-    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)lastFBO);
-    glViewport(lastViewport[0], lastViewport[1], lastViewport[2], lastViewport[3]);
+    SSAO_PASS("upload");
     
-    glUseProgram(compositeProgram);
+    // Camera constants, only recomputed when the camera moves
+    bool cameraOK = UpdateCameraConstants(in.viewMatrix, in.projMatrix, in.nearPlane, in.farPlane);
+    if(!cameraOK && !camConsts.valid) {
+        staticFrame.Invalidate();
+        return;
+    }
+    const CameraConstants& cc = camConsts;
+    
+    // Static frame: only the scene copy and composite run, on last frame's AO
+    bool reuse = pStaticReuse->GetBool() && staticFrame.Unchanged(in, !cameraOK || cc.changed);
+    
+    // A checkerboard frame is only exact once both halves were shaded from
+    // the same viewpoint, so reuse waits for one computed frame at rest
+    static bool checkerboardSettled = false;
+    if(checkerboard && !checkerboardSettled) reuse = false;
+    // Off, its history would only keep a pool target alive
+    if(!checkerboard) {
+        checkerboardHistory = 0;
+        checkerboardSettled = false;
+    }
+    // Same for bands still holding AO from before the last change
+    if(amortize && !amortizer.Settled()) reuse = false;
+    // Off, nothing holds the history and turning it back on starts from a full frame
+    if(!amortize) {
+        amortizedHistory = 0;
+        amortizer.Invalidate();
+    }
     
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sceneTexture);
-    glUniform1i(compositeUniforms.sceneTex, 0);
+    AOTechnique* technique = nullptr;
+    if(!reuse) {
+        if(depthTexture) glDeleteTextures(1, &depthTexture);
+        depthTexture = UploadDepthTexture(in.depthPixels, in.depthWidth, in.depthHeight, in.depthBits);
+        
+        technique = SelectAOTechnique(pTechnique->GetString());
+        if(!depthTexture || !technique) {
+            staticFrame.Invalidate();
+            return;
+        }
+    }
     
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, aoTexture);
-    glUniform1i(compositeUniforms.aoTex, 1);
+    // Save GL state
+    GLint lastFBO, lastViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &lastFBO);
+    glGetIntegerv(GL_VIEWPORT, lastViewport);
+    GLboolean lastDepthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean lastStencilTest = glIsEnabled(GL_STENCIL_TEST);
+    GLboolean lastScissorTest = glIsEnabled(GL_SCISSOR_TEST);
+    GLint lastScissor[4];
+    glGetIntegerv(GL_SCISSOR_BOX, lastScissor);
+    GLRasterState lastRaster;
+    lastRaster.Save();
+    
+    // The AO targets carry a depth-stencil attachment, keep the game's
+    // depth test from touching it. Stencil is enabled by the sky mask only,
+    // the scissor test by the graph around passes that declare a rect.
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    glBindVertexArray(quadVAO);
     
-    glUniform1i(compositeUniforms.debugMode, pDebugMode->GetInt());
+    // Every pass is declared each frame; the settings only decide which
+    // outputs feed the composite, and the graph culls the rest
+    RenderGraph& graph = frameGraph;
+    graph.Reset();
+    graph.passHook = MarkPass;
+    
+    RGHandle backbuffer = graph.ImportFramebuffer("backbuffer", (GLuint)lastFBO, lastViewport);
+    RGHandle scene = graph.Create("scene", RG_RGBA8, width, height);
+    RGHandle output;
+    RGHandle checkerboardOutput = -1;
+    RGHandle amortizedOutput = -1;
+    
+    // === PASS 0: Capture scene ===
+    graph.AddPass("scene", [&](const RenderGraph& g) {
+        glBindTexture(GL_TEXTURE_2D, g.Texture(scene));
+        CaptureSceneTexture((GLuint)lastFBO, width, height);
+    }).Read(backbuffer).Write(scene, RG_LOAD_DONTCARE);
+    
+    // Declared outside the branch: the pass lambdas below hold references
+    bool skyStencil = pSkyStencil->GetBool();
+    bool multiRes = pMultiRes->GetBool();
+    bool techniqueReady = false;
+    RGHandle depth = -1, history = -1, coarse = -1, ao = -1, aoFull = -1, blurH = -1;
+    
+    // Alternates per computed frame, so two frames cover every pixel
+    static int checkerboardParity = 0;
+    int parity = -1;
+    if(checkerboard && !reuse) parity = (checkerboardParity ^= 1);
+    
+    // Full frame on the first AO pass; the program keeps its uniforms, so
+    // the next one only rebinds the program and depth
+    auto useTechnique = [&]() {
+        if(!techniqueReady) {
+            technique->BeginFrame(cc, width, height, depthTexture);
+            techniqueReady = true;
+            return;
+        }
+        glUseProgram(technique->program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+    };
     
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    if(reuse) {
+        output = graph.ImportTexture("ao_history", aoTexture, aoWidth, aoHeight);
+        
+        // Not read, but imported so the pool keeps it for the next computed frame
+        if(checkerboard && checkerboardHistory)
+            graph.ImportTexture("checkerboard_history", checkerboardHistory, aoWidth, aoHeight);
+        if(amortize && amortizedHistory)
+            graph.ImportTexture("amortized_history", amortizedHistory, aoWidth, aoHeight);
+    } else {
+        depth = graph.ImportTexture("depth", depthTexture, in.depthWidth, in.depthHeight);
+        history = checkerboardHistory ?
+            graph.ImportTexture("checkerboard_history", checkerboardHistory, aoWidth, aoHeight) : -1;
+        checkerboardSettled = history >= 0 && cameraOK && !cc.changed;
+        RGHandle mask = graph.Create("skymask", RG_DEPTH24_STENCIL8, shadeWidth, aoHeight);
+        coarse = graph.Create("coarse", RG_R16F, coarseWidth, coarseHeight);
+        RGHandle resolved = graph.Create("checkerboard", RG_RG16F, aoWidth, aoHeight);
+        blurH = graph.Create("blur_h", RG_R16F, aoWidth, aoHeight);
+        RGHandle blurV = graph.Create("blur_v", RG_R16F, aoWidth, aoHeight);
+        
+        // Amortized mode draws one band into last frame's unblurred AO;
+        // the first frame of a history computes all of it
+        int region = amortize ?
+            amortizer.Schedule(in, cc, regions, aoWidth, aoHeight, amortizedHistory != 0) : -1;
+        if(region >= 0)
+            ao = graph.ImportTexture("amortized_history", amortizedHistory, aoWidth, aoHeight);
+        else
+            ao = graph.Create("ao", RG_R16F, shadeWidth, aoHeight);
+        if(amortize) {
+            amortizedOutput = ao;
+            graph.Export(ao);
+        }
+        
+        // Band rows in the AO and coarse targets. The coarse band keeps a
+        // texel of margin for the AO pass's bilinear fetches.
+        GLint band[4] = { 0, 0, aoWidth, aoHeight };
+        GLint coarseBand[4] = { 0, 0, coarseWidth, coarseHeight };
+        if(region >= 0) {
+            int y0, y1;
+            amortizer.Rows(region, aoHeight, y0, y1);
+            band[1] = y0;
+            band[3] = y1 - y0;
+            
+            amortizer.Rows(region, coarseHeight, y0, y1);
+            y0 = y0 > 0 ? y0 - 1 : 0;
+            y1 = y1 < coarseHeight ? y1 + 1 : coarseHeight;
+            coarseBand[1] = y0;
+            coarseBand[3] = y1 - y0;
+        }
+        const GLint* aoRect = region >= 0 ? band : nullptr;
+        const GLint* coarseRect = region >= 0 ? coarseBand : nullptr;
+        
+        // Sky pixels never reach the AO or blur shaders, so masked targets
+        // must already hold 1.0 (no occlusion). The blur runs unmasked on
+        // the reconstructed full-width AO in checkerboard mode, and on the
+        // whole amortized AO while the mask covers one band.
+        RGHandle aoMask = skyStencil ? mask : -1;
+        RGHandle blurMask = checkerboard || amortize ? -1 : aoMask;
+        RGLoad blurLoad = blurMask >= 0 ? RG_LOAD_CLEAR : RG_LOAD_DONTCARE;
+        // Amortized bands outside the scissor keep their AO
+        RGLoad aoLoad = skyStencil || region >= 0 ? RG_LOAD_KEEP : RG_LOAD_DONTCARE;
+        
+        // === PASS 1: Coarse wide-radius AO (multi-resolution mode) ===
+        // Few taps over a large radius at low resolution, so the cost of
+        // large-scale occlusion does not grow with the radius. Runs before
+        // the sky mask so the mask, AO and blur passes stay on one target.
+        graph.AddPass("coarse", [&](const RenderGraph&) {
+            useTechnique();
+            technique->Draw(coarseWidth, coarseHeight, pCoarseSamples->GetInt(), pCoarseRadius->GetFloat(),
+                            0, 0, 0, -1);
+        }).Read(depth).Write(coarse, RG_LOAD_DONTCARE).Scissor(coarseRect);
+        
+        // === PASS 2: Sky mask ===
+        // Stencil = 1 on geometry, tested early by the AO and blur passes.
+        // Only a masked AO pass needs its clear; unmasked, this pass is culled.
+        graph.AddPass("skymask", [&](const RenderGraph&) {
+            glUseProgram(skyMaskProgram);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            glUniform2f(skyMaskUniforms.screenSize, (float)aoWidth, (float)aoHeight);
+            glUniform1i(skyMaskUniforms.checkerboard, parity);
+            
+            glEnable(GL_STENCIL_TEST);
+            glStencilFunc(GL_ALWAYS, 1, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            
+            glStencilFunc(GL_EQUAL, 1, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        }).Read(depth).Write(aoMask >= 0 ? ao : -1, RG_LOAD_CLEAR, 1.0f)
+          .Attach(mask, RG_LOAD_CLEAR).Scissor(aoRect);
+        
+        // === PASS 3: Compute AO ===
+        // Keeps the sky mask's clear when masked, covers every pixel otherwise
+        graph.AddPass("ao", [&](const RenderGraph& g) {
+            useTechnique();
+            technique->Draw(aoWidth, aoHeight, pSamples->GetInt(), pRadius->GetFloat(),
+                            g.Texture(multiRes ? coarse : -1), coarseWidth, coarseHeight, parity);
+        }).Read(depth).Read(multiRes ? coarse : -1)
+          .Write(ao, aoLoad).Attach(aoMask, RG_LOAD_KEEP).Scissor(aoRect);
+        
+        // === PASS 3b: Checkerboard reconstruction ===
+        // Skipped pixels from the reprojected history or shaded neighbours
+        graph.AddPass("checkerboard", [&](const RenderGraph& g) {
+            glUseProgram(checkerboardProgram);
+            
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, g.Texture(ao));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, g.Texture(history));
+            
+            glUniformMatrix4fv(checkerboardUniforms.reprojection, 1, GL_FALSE, cc.reprojection);
+            glUniform4fv(checkerboardUniforms.projInfo, 1, cc.projInfo);
+            glUniform2fv(checkerboardUniforms.depthParams, 1, cc.depthParams);
+            glUniform1f(checkerboardUniforms.projW, cc.proj[11]);
+            glUniform2f(checkerboardUniforms.screenSize, (float)aoWidth, (float)aoHeight);
+            glUniform1i(checkerboardUniforms.parity, parity);
+            glUniform1i(checkerboardUniforms.historyValid, history >= 0 ? 1 : 0);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }).Read(ao).Read(depth).Read(history).Write(resolved, RG_LOAD_DONTCARE);
+        
+        aoFull = ao;
+        if(checkerboard) {
+            aoFull = checkerboardOutput = resolved;
+            graph.Export(resolved);
+        }
+        
+        // === PASS 4: Bilateral Blur ===
+        // Optional with FusedDenoise, which already averages each 2x2 quad
+        graph.AddPass("blur_h", [&](const RenderGraph& g) {
+            glUseProgram(blurProgram);
+            
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            glUniform1i(blurUniforms.depthTex, 1);
+            glUniform1f(blurUniforms.radius, (float)SetBlurKernel(pBlurRadius->GetInt()));
+            glUniform2f(blurUniforms.screenSize, (float)aoWidth, (float)aoHeight);
+            glUniform1i(blurUniforms.depthAligned,
+                        in.depthWidth == aoWidth && in.depthHeight == aoHeight ? 1 : 0);
+            
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, g.Texture(aoFull));
+            glUniform1i(blurUniforms.aoTex, 0);
+            glUniform1i(blurUniforms.direction, 0);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }).Read(aoFull).Read(depth).Write(blurH, blurLoad, 1.0f).Attach(blurMask, RG_LOAD_KEEP);
+        
+        graph.AddPass("blur_v", [&](const RenderGraph& g) {
+            glBindTexture(GL_TEXTURE_2D, g.Texture(blurH));
+            glUniform1i(blurUniforms.direction, 1);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }).Read(blurH).Write(blurV, blurLoad, 1.0f).Attach(blurMask, RG_LOAD_KEEP);
+        
+        // FusedDenoise without fine derivatives keeps the blur it replaces
+        bool blur = pBlurEnabled->GetBool() || (pFusedDenoise->GetBool() && !fineDerivatives);
+        output = blur ? blurV : aoFull;
+        graph.Export(output);
+    }
+    
+    // === PASS 5: Composite ===
+    // Unmasked: the sky mask leaves the stencil test on, and the game's own
+    // stencil buffer must not clip the composite
+    graph.AddPass("composite", [&](const RenderGraph& g) {
+        glDisable(GL_STENCIL_TEST);
+        DrawComposite(g.Texture(scene), g.Texture(output));
+    }).Read(scene).Read(output).Write(backbuffer, RG_LOAD_KEEP);
+    
+    if(graph.Compile()) {
+        if(graph.poolChanged)
+            logger->Info("SSAO render targets: %d, %u KB", (int)graph.pool.size(),
+                         (unsigned)(graph.PoolBytes() / 1024));
+        
+        graph.Execute();
+        if(!reuse) {
+            aoTexture = graph.Texture(output);
+            checkerboardHistory = graph.Texture(checkerboardOutput);
+            amortizedHistory = graph.Texture(amortizedOutput);
+        }
+    } else {
+        logger->Error("Framebuffer incomplete!");
+        staticFrame.Invalidate();
+        aoTexture = 0;
+        checkerboardHistory = 0;
+        amortizedHistory = 0;
+        amortizer.Invalidate();
+        
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)lastFBO);
+        glViewport(lastViewport[0], lastViewport[1], lastViewport[2], lastViewport[3]);
+    }
     
     // Cleanup
     glBindVertexArray(0);
     glUseProgram(0);
+    lastRaster.Restore();
+    if(lastDepthTest) glEnable(GL_DEPTH_TEST);
+    if(lastStencilTest) glEnable(GL_STENCIL_TEST);
+    else glDisable(GL_STENCIL_TEST);
+    glScissor(lastScissor[0], lastScissor[1], lastScissor[2], lastScissor[3]);
+    if(lastScissorTest) glEnable(GL_SCISSOR_TEST);
     
     // Delete temporary depth texture
     if(depthTexture) {
         glDeleteTextures(1, &depthTexture);
         depthTexture = 0;
     }
+    
+    SSAO_PASS(nullptr);
+}
+
+void RenderSSAO(RwCamera* camera) {
+    if(!pEnabled->GetBool()) return;
+    if(!camera || !camera->bufferColor) return;
+    
+    RwRaster* frameBuffer = camera->bufferColor;
+    RwRaster* zBuffer = (g_pZBuffer && *g_pZBuffer) ? *g_pZBuffer : camera->bufferDepth;
+    
+    if(!zBuffer) {
+        logger->Error("No Z-buffer available");
+        return;
+    }
+    if(!zBuffer->pixels) {
+        logger->Error("Invalid Z-buffer");
+        return;
+    }
+    
+    float* viewMat = GetCurrentViewMatrix();
+    float* projMat = GetCurrentProjectionMatrix();
+    
+    if(!viewMat || !projMat) {
+        logger->Error("Failed to get matrices");
+        return;
+    }
+    
+    SSAOFrameInput in;
+    in.depthWidth = zBuffer->width;
+    in.depthHeight = zBuffer->height;
+    in.depthBits = zBuffer->depth;
+    in.viewMatrix = viewMat;
+    in.projMatrix = projMat;
+    in.nearPlane = camera->nearplane;
+    in.farPlane = camera->farplane;
+    in.width = frameBuffer->width;
+    in.height = frameBuffer->height;
+    
+    // Lock raster to get pixel data
+    if(RwRasterLock) {
+        RwRasterLock(zBuffer, 0, 2); // RASTER_LOCK_READ
+    }
+    in.depthPixels = zBuffer->pixels;
+    
+    CaptureFrame(in);
+    RenderSSAOFrame(in);
+    
+    if(RwRasterUnlock) {
+        RwRasterUnlock(zBuffer);
+    }
+}
+
+// ============================================================================
+// PRESETS
+// ============================================================================
+
+// Keys a preset may set, in the format written by tools/ssao_autotune.cpp:
+//   [Tier]
+//   Key=Value
+struct PresetKey {
+    const char* key;
+    ConfigEntry** entry;
+};
+
+PresetKey presetKeys[] = {
+    { "Samples",         &pSamples },
+    { "Radius",          &pRadius },
+    { "Density",         &pDensity },
+    { "BlurEnabled",     &pBlurEnabled },
+    { "BlurRadius",      &pBlurRadius },
+    { "ResolutionScale", &pResolutionScale },
+    { "Checkerboard",    &pCheckerboard },
+    { "AmortizeRegions", &pAmortizeRegions },
+    { "MultiResolution", &pMultiRes },
+    { "CoarseScale",     &pCoarseScale },
+    { "CoarseSamples",   &pCoarseSamples },
+    { "CoarseRadius",    &pCoarseRadius },
+    { "Technique",       &pTechnique },
+    { "FusedDenoise",    &pFusedDenoise },
+    { "SkyStencil",      &pSkyStencil },
+    { "AdaptiveSamples", &pAdaptiveSamples },
+    { "MinSamples",      &pMinSamples },
+};
+
+bool LoadPreset(const char* path, const char* name) {
+    FILE* f = fopen(path, "r");
+    if(!f) {
+        logger->Error("Cannot open preset file %s", path);
+        return false;
+    }
+    
+    size_t nameLen = strlen(name);
+    bool inSection = false, found = false;
+    char line[256];
+    
+    while(fgets(line, sizeof(line), f)) {
+        char* end = line + strlen(line);
+        while(end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' '))
+            *--end = 0;
+        
+        if(!line[0] || line[0] == ';' || line[0] == '#') continue;
+        
+        if(line[0] == '[') {
+            inSection = strncmp(line + 1, name, nameLen) == 0 && line[1 + nameLen] == ']';
+            found |= inSection;
+            continue;
+        }
+        if(!inSection) continue;
+        
+        char* eq = strchr(line, '=');
+        if(!eq) continue;
+        *eq = 0;
+        
+        bool known = false;
+        for(PresetKey& k : presetKeys) {
+            if(strcmp(k.key, line) == 0) {
+                (*k.entry)->SetString(eq + 1);
+                known = true;
+                break;
+            }
+        }
+        if(!known) logger->Error("Preset %s: unknown key %s", name, line);
+    }
+    fclose(f);
+    
+    if(!found) logger->Error("Preset %s not found in %s", name, path);
+    return found;
 }
 
 // ============================================================================
@@ -934,6 +2700,7 @@ void _rwCameraValRender_Hook(RwCamera* camera) {
     _rwCameraValRender_orig(camera);
     
     // Apply SSAO
+    TraceFrameScope trace;
     RenderSSAO(camera);
 }
 
@@ -952,8 +2719,33 @@ extern "C" void OnModPreLoad() {
     pBlurRadius = cfg->Bind("BlurRadius", 3, "Blur kernel radius (1-5)");
     pDebugMode = cfg->Bind("DebugMode", 0, "0=Normal, 1=AO only, 2=Split");
     pResolutionScale = cfg->Bind("ResolutionScale", 0.75f, "AO resolution scale (0.5-1.0)");
+    pCheckerboard = cfg->Bind("Checkerboard", false, "Full-res AO on alternating pixel halves, rest reprojected (ignores ResolutionScale)");
+    pAmortizeRegions = cfg->Bind("AmortizeRegions", 1, "Recompute AO for one of N screen bands per frame, the rest keeps its last result (1=off, max 8, not with Checkerboard)");
+    pMultiRes = cfg->Bind("MultiResolution", false, "Add a wide-radius low-res AO level");
+    pCoarseScale = cfg->Bind("CoarseScale", 0.25f, "Coarse AO level scale (0.125-0.25)");
+    pCoarseSamples = cfg->Bind("CoarseSamples", 6, "Coarse AO level samples (4-8)");
+    pCoarseRadius = cfg->Bind("CoarseRadius", 6.0f, "Coarse AO level radius");
+    pTechnique = cfg->Bind("Technique", "SAO", "AO algorithm: SAO, HBAO, GTAO");
+    pFusedDenoise = cfg->Bind("FusedDenoise", false, "Denoise 2x2 quads in the AO pass (lets BlurEnabled=0 drop the blur passes)");
+    pSkyStencil = cfg->Bind("SkyStencil", true, "Skip sky pixels in AO/blur with an early stencil test");
+    pAdaptiveSamples = cfg->Bind("AdaptiveSamples", false, "Pick taps per 8x8 tile from projected radius, Samples is the maximum");
+    pMinSamples = cfg->Bind("MinSamples", 4, "Fewest taps in adaptive mode");
+    pTextureGather = cfg->Bind("TextureGather", true, "Use textureGather for normals and blur on GLES 3.1+");
+    pStaticReuse = cfg->Bind("StaticReuse", true, "Reuse last AO while camera and depth are unchanged");
+    pStaticRefresh = cfg->Bind("StaticRefresh", 60, "Recompute a static frame at least every N frames (0=never)");
+    pCaptureFrames = cfg->Bind("CaptureFrames", 0, "Frames to record for offline replay (0=off)");
+    pCapturePath = cfg->Bind("CapturePath", "/sdcard/Android/data/com.rockstargames.gtasa/files/ssao_capture.ssac", "Capture output file");
+    pCaptureCompress = cfg->Bind("CaptureCompress", false, "LZ4-compress captured depth (LZ4 builds only)");
+    pTraceFrames = cfg->Bind("TraceFrames", 0, "Frames to trace GL calls for (SSAO_GL_TRACE builds only, 0=off)");
+    pTracePath = cfg->Bind("TracePath", "/sdcard/Android/data/com.rockstargames.gtasa/files/ssao_trace.json", "Chrome trace output file");
+    pPreset = cfg->Bind("Preset", "", "Device tier to load from PresetFile (empty=off)");
+    pPresetFile = cfg->Bind("PresetFile", "/sdcard/Android/data/com.rockstargames.gtasa/files/ssao_presets.ini", "Tiers written by ssao_autotune");
     
     cfg->Save();
+    
+    // Applied after saving so the file keeps the hand-set values
+    if(pPreset->GetString()[0] && LoadPreset(pPresetFile->GetString(), pPreset->GetString()))
+        logger->Info("Loaded preset %s", pPreset->GetString());
 }
 
 extern "C" void OnModLoad() {
@@ -988,21 +2780,25 @@ extern "C" void OnModLoad() {
 extern "C" void OnModUnload() {
     logger->Info("Unloading SSAO...");
     
+    captureWriter.Close();
+#ifdef SSAO_GL_TRACE
+    ssaoGLTrace.Close();
+#endif
+    
     // Cleanup OpenGL resources
-    if(aoProgram) glDeleteProgram(aoProgram);
+    for(AOTechnique* t : aoTechniques) t->Shutdown();
     if(blurProgram) glDeleteProgram(blurProgram);
     if(compositeProgram) glDeleteProgram(compositeProgram);
+    if(skyMaskProgram) glDeleteProgram(skyMaskProgram);
+    if(checkerboardProgram) glDeleteProgram(checkerboardProgram);
     
     if(quadVAO) glDeleteVertexArrays(1, &quadVAO);
     if(quadVBO) glDeleteBuffers(1, &quadVBO);
     
-    if(aoFBO) glDeleteFramebuffers(1, &aoFBO);
-    if(blurFBO) glDeleteFramebuffers(1, &blurFBO);
-    if(compositeFBO) glDeleteFramebuffers(1, &compositeFBO);
-    
-    if(aoTexture) glDeleteTextures(1, &aoTexture);
-    if(blurTexture) glDeleteTextures(1, &blurTexture);
-    if(sceneTexture) glDeleteTextures(1, &sceneTexture);
+    frameGraph.Release();
+    aoTexture = 0;
+    checkerboardHistory = 0;
+    amortizedHistory = 0;
     if(depthTexture) glDeleteTextures(1, &depthTexture);
     
     logger->Info("SSAO unloaded successfully");
@@ -0,0 +1,239 @@
+#pragma once
+
+// ============================================================================
+// SSAO FRAME CAPTURE FORMAT
+// ============================================================================
+//
+// Raw SSAO pipeline inputs (Z-raster, view/projection, clip planes, config)
+// recorded in the game and replayed on a desktop without it.
+//
+// File layout, native little endian:
+//   SSAOCaptureHeader
+//   SSAOCaptureFrame + depth payload, repeated; every record is padded to
+//   SSAO_CAPTURE_ALIGN so payloads of an mmap'd file can be handed to
+//   glTexImage2D in place.
+//
+// Uncompressed payloads are the locked raster bytes: 2 bytes per texel for
+// 16-bit Z, 4 bytes (GL_UNSIGNED_INT / GL_FLOAT) for 24/32-bit Z. LZ4 is
+// available when built with SSAO_CAPTURE_LZ4; such frames are decompressed
+// into a scratch buffer on replay.
+//
+// The reader only opens files of SSAO_CAPTURE_VERSION; re-record captures
+// after a version bump.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef SSAO_CAPTURE_LZ4
+#include <lz4.h>
+#endif
+
+#define SSAO_CAPTURE_MAGIC   "SSAC"
+#define SSAO_CAPTURE_VERSION 2
+#define SSAO_CAPTURE_ALIGN   16
+
+enum SSAOCaptureCompression : uint32_t {
+    SSAO_CAPTURE_RAW = 0,
+    SSAO_CAPTURE_LZ4 = 1,
+};
+
+struct SSAOCaptureHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;  // sizeof(SSAOCaptureHeader) of the writer
+    uint32_t frameCount;  // patched on close, 0 if the writer never closed
+    char config[512];     // "Key=Value;..." snapshot of the mod config
+};
+
+struct SSAOCaptureFrame {
+    uint32_t recordSize;  // header + payload + padding, offset to the next frame
+    uint32_t index;
+    int32_t width, height;
+    int32_t depthBits;
+    uint32_t compression;
+    uint32_t payloadSize; // bytes stored after this header
+    uint32_t rawSize;     // bytes after decompression
+    float viewMatrix[16];
+    float projMatrix[16];
+    float nearPlane, farPlane;
+    int32_t targetWidth, targetHeight; // color buffer the AO was composited into
+};
+
+static_assert(sizeof(SSAOCaptureHeader) % SSAO_CAPTURE_ALIGN == 0, "header breaks payload alignment");
+static_assert(sizeof(SSAOCaptureFrame) % SSAO_CAPTURE_ALIGN == 0, "frame header breaks payload alignment");
+
+inline uint32_t SSAOCaptureDepthSize(int width, int height, int depthBits) {
+    return (uint32_t)width * (uint32_t)height * (depthBits == 16 ? 2u : 4u);
+}
+
+// ============================================================================
+// WRITER
+// ============================================================================
+
+struct SSAOCaptureWriter {
+    FILE* file = nullptr;
+    uint32_t frameCount = 0;
+    std::vector<char> scratch;
+    
+    bool Open(const char* path, const char* config) {
+        file = fopen(path, "wb");
+        if(!file) return false;
+        
+        SSAOCaptureHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SSAO_CAPTURE_MAGIC, 4);
+        header.version = SSAO_CAPTURE_VERSION;
+        header.headerSize = sizeof(header);
+        snprintf(header.config, sizeof(header.config), "%s", config);
+        
+        frameCount = 0;
+        return fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+    
+    bool WriteFrame(SSAOCaptureFrame frame, const void* depth, bool compress) {
+        if(!file) return false;
+        
+        frame.index = frameCount;
+        frame.rawSize = SSAOCaptureDepthSize(frame.width, frame.height, frame.depthBits);
+        frame.compression = SSAO_CAPTURE_RAW;
+        frame.payloadSize = frame.rawSize;
+        const void* payload = depth;
+
+#ifdef SSAO_CAPTURE_LZ4
+        if(compress) {
+            scratch.resize(LZ4_compressBound((int)frame.rawSize));
+            int packed = LZ4_compress_default((const char*)depth, scratch.data(),
+                                              (int)frame.rawSize, (int)scratch.size());
+            if(packed > 0 && (uint32_t)packed < frame.rawSize) {
+                frame.compression = SSAO_CAPTURE_LZ4;
+                frame.payloadSize = (uint32_t)packed;
+                payload = scratch.data();
+            }
+        }
+#else
+        (void)compress;
+#endif
+        
+        uint32_t padding = (SSAO_CAPTURE_ALIGN - frame.payloadSize % SSAO_CAPTURE_ALIGN) % SSAO_CAPTURE_ALIGN;
+        frame.recordSize = sizeof(frame) + frame.payloadSize + padding;
+        
+        static const char zeros[SSAO_CAPTURE_ALIGN] = {};
+        if(fwrite(&frame, sizeof(frame), 1, file) != 1) return false;
+        if(fwrite(payload, 1, frame.payloadSize, file) != frame.payloadSize) return false;
+        if(padding && fwrite(zeros, 1, padding, file) != padding) return false;
+        
+        frameCount++;
+        return true;
+    }
+    
+    void Close() {
+        if(!file) return;
+        fseek(file, offsetof(SSAOCaptureHeader, frameCount), SEEK_SET);
+        fwrite(&frameCount, sizeof(frameCount), 1, file);
+        fclose(file);
+        file = nullptr;
+    }
+};
+
+// ============================================================================
+// READER
+// ============================================================================
+
+// One replayed frame. depth points into the mapping for raw frames and
+// into the reader's scratch buffer for compressed ones; it stays valid
+// until the next call to Next().
+struct SSAOCaptureView {
+    const SSAOCaptureFrame* frame;
+    const void* depth;
+};
+
+struct SSAOCaptureReader {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    const SSAOCaptureHeader* header = nullptr;
+    std::vector<char> scratch;
+    
+    bool Open(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if(fd < 0) return false;
+        
+        struct stat st;
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SSAOCaptureHeader)) {
+            close(fd);
+            return false;
+        }
+        
+        void* mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mapped == MAP_FAILED) return false;
+        
+        data = (const unsigned char*)mapped;
+        size = (size_t)st.st_size;
+        header = (const SSAOCaptureHeader*)data;
+        
+        if(memcmp(header->magic, SSAO_CAPTURE_MAGIC, 4) != 0 ||
+           header->version != SSAO_CAPTURE_VERSION ||
+           header->headerSize < sizeof(SSAOCaptureHeader) ||
+           header->headerSize > size) {
+            Close();
+            return false;
+        }
+        
+        Rewind();
+        return true;
+    }
+    
+    void Rewind() {
+        offset = header ? header->headerSize : 0;
+    }
+    
+    // Returns false at the end of the file or on a truncated record
+    bool Next(SSAOCaptureView& out) {
+        if(!data || offset + sizeof(SSAOCaptureFrame) > size) return false;
+        
+        const SSAOCaptureFrame* frame = (const SSAOCaptureFrame*)(data + offset);
+        if(frame->recordSize < sizeof(SSAOCaptureFrame) + frame->payloadSize ||
+           offset + frame->recordSize > size ||
+           frame->rawSize != SSAOCaptureDepthSize(frame->width, frame->height, frame->depthBits))
+            return false;
+        
+        const void* payload = data + offset + sizeof(SSAOCaptureFrame);
+        
+        if(frame->compression == SSAO_CAPTURE_RAW) {
+            if(frame->payloadSize != frame->rawSize) return false;
+            out.depth = payload;
+        }
+#ifdef SSAO_CAPTURE_LZ4
+        else if(frame->compression == SSAO_CAPTURE_LZ4) {
+            scratch.resize(frame->rawSize);
+            int unpacked = LZ4_decompress_safe((const char*)payload, scratch.data(),
+                                               (int)frame->payloadSize, (int)frame->rawSize);
+            if(unpacked != (int)frame->rawSize) return false;
+            out.depth = scratch.data();
+        }
+#endif
+        else {
+            return false;
+        }
+        
+        out.frame = frame;
+        offset += frame->recordSize;
+        return true;
+    }
+    
+    void Close() {
+        if(data) munmap((void*)data, size);
+        data = nullptr;
+        header = nullptr;
+        size = offset = 0;
+    }
+};
@@ -0,0 +1,741 @@
+#pragma once
+
+// ============================================================================
+// SSAO GL TRACE
+// ============================================================================
+//
+// Optional tracing layer over the GL entry points of the render hook. In
+// builds with SSAO_GL_TRACE, this header redefines those entry points as
+// macros that time every call and check it against shadowed state:
+//   - calls and CPU time per frame and per entry point
+//   - redundant binds and state sets, where the bound object or value did
+//     not change
+//   - redundant uniform sets, with the same value for the same program
+//     and location
+//   - queries that can make the driver sync with the GPU thread:
+//     glGet*, glIsEnabled, glCheckFramebufferStatus, glReadPixels and
+//     glFinish
+// Frames are bracketed by BeginFrame() and EndFrame(). Each frame yields a
+// summary, and Open() also writes a Chrome trace-event file (for
+// chrome://tracing or Perfetto) with the frame, its passes and every call.
+//
+// Binding state is forgotten at BeginFrame(), because the game changes it
+// untraced between frames. Uniform values belong to the program, so they
+// are kept across frames: a matrix re-sent unchanged each frame counts as
+// redundant.
+//
+// Include after <GLES3/gl3.h> and before any code that calls GL. Without
+// SSAO_GL_TRACE this header is empty.
+
+#ifdef SSAO_GL_TRACE
+
+#include <GLES3/gl3.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+// Traced entry points; the flag marks calls that may stall
+#define SSAO_TRACE_CALLS(X) \
+    X(glActiveTexture, 0) X(glBindTexture, 0) X(glBindFramebuffer, 0) \
+    X(glBindRenderbuffer, 0) X(glBindVertexArray, 0) X(glUseProgram, 0) \
+    X(glViewport, 0) X(glScissor, 0) X(glEnable, 0) X(glDisable, 0) \
+    X(glStencilFunc, 0) X(glStencilOp, 0) X(glStencilMask, 0) X(glColorMask, 0) \
+    X(glStencilFuncSeparate, 0) X(glStencilOpSeparate, 0) X(glStencilMaskSeparate, 0) \
+    X(glUniform1i, 0) X(glUniform1f, 0) X(glUniform2f, 0) X(glUniform1fv, 0) \
+    X(glUniform2fv, 0) X(glUniform4fv, 0) X(glUniformMatrix4fv, 0) \
+    X(glDrawArrays, 0) X(glClearBufferfv, 0) X(glClearBufferfi, 0) \
+    X(glInvalidateFramebuffer, 0) \
+    X(glGenTextures, 0) X(glDeleteTextures, 0) X(glTexImage2D, 0) \
+    X(glTexStorage2D, 0) X(glTexParameteri, 0) X(glCopyTexSubImage2D, 0) \
+    X(glGenFramebuffers, 0) X(glDeleteFramebuffers, 0) \
+    X(glFramebufferTexture2D, 0) X(glFramebufferRenderbuffer, 0) \
+    X(glGenRenderbuffers, 0) X(glDeleteRenderbuffers, 0) \
+    X(glRenderbufferStorage, 0) X(glDeleteProgram, 0) \
+    X(glGetIntegerv, 1) X(glGetBooleanv, 1) X(glIsEnabled, 1) X(glCheckFramebufferStatus, 1) \
+    X(glGetShaderiv, 1) X(glGetProgramiv, 1) X(glGetShaderInfoLog, 1) \
+    X(glGetProgramInfoLog, 1) X(glGetUniformLocation, 1) \
+    X(glGetError, 1) X(glReadPixels, 1) X(glFinish, 1)
+
+enum SSAOTraceCall {
+#define SSAO_TRACE_ENUM(name, stall) SSAO_CALL_##name,
+    SSAO_TRACE_CALLS(SSAO_TRACE_ENUM)
+#undef SSAO_TRACE_ENUM
+    SSAO_CALL_COUNT
+};
+
+// Shadowed binding and fixed-function state, one slot per value
+enum SSAOTraceState {
+    SSAO_STATE_ACTIVE_TEXTURE,
+    SSAO_STATE_TEXTURE0, // GL_TEXTURE_2D binding per unit
+    SSAO_STATE_PROGRAM = SSAO_STATE_TEXTURE0 + 16,
+    SSAO_STATE_DRAW_FRAMEBUFFER,
+    SSAO_STATE_READ_FRAMEBUFFER,
+    SSAO_STATE_RENDERBUFFER,
+    SSAO_STATE_VERTEX_ARRAY,
+    SSAO_STATE_VIEWPORT,
+    SSAO_STATE_SCISSOR_BOX,
+    SSAO_STATE_STENCIL_FUNC,
+    SSAO_STATE_STENCIL_OP,
+    SSAO_STATE_STENCIL_MASK,
+    SSAO_STATE_COLOR_MASK,
+    SSAO_STATE_DEPTH_TEST,
+    SSAO_STATE_STENCIL_TEST,
+    SSAO_STATE_BLEND,
+    SSAO_STATE_CULL_FACE,
+    SSAO_STATE_SCISSOR_TEST,
+    SSAO_STATE_COUNT
+};
+
+struct SSAOTraceCallStats {
+    uint32_t calls;
+    uint32_t redundant;
+    double ms;
+};
+
+struct SSAOTraceFrameStats {
+    uint32_t frames;            // 1 for a single frame, the count for totals
+    uint32_t calls;
+    uint32_t redundantBinds;    // binds and state sets
+    uint32_t redundantUniforms;
+    uint32_t stalls;
+    double cpuMs;               // BeginFrame() to EndFrame()
+    double glMs;                // inside traced calls
+};
+
+struct SSAOTraceEvent {
+    const char* name;
+    const char* category;
+    double start, duration; // ms since Open()
+    bool redundant;
+};
+
+struct SSAOGLTracer {
+    FILE* file = nullptr;
+    bool firstEvent = true;
+    bool inFrame = false;
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    
+    SSAOTraceFrameStats frame = {}; // current, or last finished
+    SSAOTraceFrameStats total = {}; // all frames since Open()
+    SSAOTraceCallStats perCall[SSAO_CALL_COUNT] = {};
+    
+    std::vector<SSAOTraceEvent> events;
+    double frameStart = 0.0;
+    const char* pass = nullptr;
+    double passStart = 0.0;
+    
+    uint64_t state[SSAO_STATE_COUNT];
+    bool stateKnown[SSAO_STATE_COUNT] = {};
+    std::unordered_map<uint64_t, uint64_t> uniforms; // program << 32 | location -> value hash
+    
+    static const char* CallName(int call) {
+        static const char* names[] = {
+#define SSAO_TRACE_NAME(name, stall) #name,
+            SSAO_TRACE_CALLS(SSAO_TRACE_NAME)
+#undef SSAO_TRACE_NAME
+        };
+        return names[call];
+    }
+    
+    static bool CallStalls(int call) {
+        static const bool stalls[] = {
+#define SSAO_TRACE_STALL(name, stall) stall != 0,
+            SSAO_TRACE_CALLS(SSAO_TRACE_STALL)
+#undef SSAO_TRACE_STALL
+        };
+        return stalls[call];
+    }
+    
+    static bool CallSetsUniform(int call) {
+        return call >= SSAO_CALL_glUniform1i && call <= SSAO_CALL_glUniformMatrix4fv;
+    }
+    
+    static uint64_t Hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for(size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+    
+    double Now() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+    }
+    
+    // ------------------------------------------------------------------------
+    // Output
+    // ------------------------------------------------------------------------
+    
+    bool Open(const char* path) {
+        file = fopen(path, "w");
+        if(!file) return false;
+        
+        fputs("{\"traceEvents\":[\n", file);
+        firstEvent = true;
+        total = {};
+        for(SSAOTraceCallStats& c : perCall) c = {};
+        return true;
+    }
+    
+    void Close() {
+        if(!file) return;
+        fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+        fclose(file);
+        file = nullptr;
+    }
+    
+    void WriteEvent(const SSAOTraceEvent& e) {
+        if(!file) return;
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                      "\"ts\":%.3f,\"dur\":%.3f%s}",
+                firstEvent ? "" : ",\n", e.name, e.category, e.start * 1000.0, e.duration * 1000.0,
+                e.redundant ? ",\"args\":{\"redundant\":1}" : "");
+        firstEvent = false;
+    }
+    
+    void WriteCounters(double ts) {
+        if(!file) return;
+        fprintf(file, ",\n{\"name\":\"gl\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":%.3f,"
+                      "\"args\":{\"calls\":%u,\"redundant_binds\":%u,\"redundant_uniforms\":%u,\"stalls\":%u}}",
+                ts * 1000.0, frame.calls, frame.redundantBinds, frame.redundantUniforms, frame.stalls);
+    }
+    
+    // ------------------------------------------------------------------------
+    // Frames and passes
+    // ------------------------------------------------------------------------
+    
+    void BeginFrame() {
+        frame = {};
+        frame.frames = 1;
+        events.clear();
+        for(bool& known : stateKnown) known = false;
+        pass = nullptr;
+        inFrame = true;
+        frameStart = Now();
+    }
+    
+    // Starts a named pass, ending the previous one; nullptr only ends it
+    void Pass(const char* name) {
+        if(!inFrame) return;
+        double now = Now();
+        if(pass) events.push_back({ pass, "pass", passStart, now - passStart, false });
+        pass = name;
+        passStart = now;
+    }
+    
+    // Events are written here, outside the measured frame time
+    void EndFrame() {
+        if(!inFrame) return;
+        Pass(nullptr);
+        double end = Now();
+        frame.cpuMs = end - frameStart;
+        inFrame = false;
+        
+        total.frames++;
+        total.calls += frame.calls;
+        total.redundantBinds += frame.redundantBinds;
+        total.redundantUniforms += frame.redundantUniforms;
+        total.stalls += frame.stalls;
+        total.cpuMs += frame.cpuMs;
+        total.glMs += frame.glMs;
+        
+        WriteEvent({ "frame", "frame", frameStart, frame.cpuMs, false });
+        for(const SSAOTraceEvent& e : events) WriteEvent(e);
+        WriteCounters(frameStart);
+    }
+    
+    // ------------------------------------------------------------------------
+    // Recording, called by the wrappers
+    // ------------------------------------------------------------------------
+    
+    // Updates a shadowed slot; true if it already held value
+    bool SetState(int slot, uint64_t value) {
+        bool redundant = stateKnown[slot] && state[slot] == value;
+        state[slot] = value;
+        stateKnown[slot] = true;
+        return redundant;
+    }
+    
+    void ForgetState(int slot) {
+        stateKnown[slot] = false;
+    }
+    
+    // GL_TEXTURE_2D binding of the active unit
+    bool SetTexture(GLuint texture) {
+        if(!stateKnown[SSAO_STATE_ACTIVE_TEXTURE]) return false;
+        uint64_t unit = state[SSAO_STATE_ACTIVE_TEXTURE];
+        if(unit >= 16) return false;
+        return SetState(SSAO_STATE_TEXTURE0 + (int)unit, texture);
+    }
+    
+    // Deleted names may be handed out again, so their bindings are unknown
+    void ForgetBindings(int first, int count) {
+        for(int i = first; i < first + count; i++) stateKnown[i] = false;
+    }
+    
+    // Only traced frames are cached; program setup outside them sets
+    // samplers once and is not worth tracking
+    bool SetUniform(GLint location, const void* value, size_t size) {
+        if(!inFrame || location < 0 || !stateKnown[SSAO_STATE_PROGRAM]) return false;
+        uint64_t key = state[SSAO_STATE_PROGRAM] << 32 | (uint32_t)location;
+        uint64_t hash = Hash(value, size);
+        
+        auto it = uniforms.find(key);
+        if(it != uniforms.end() && it->second == hash) return true;
+        uniforms[key] = hash;
+        return false;
+    }
+    
+    void ForgetProgram(GLuint program) {
+        for(auto it = uniforms.begin(); it != uniforms.end();) {
+            if(it->first >> 32 == program) it = uniforms.erase(it);
+            else ++it;
+        }
+    }
+    
+    void Record(SSAOTraceCall call, bool redundant, double start, double end) {
+        if(!inFrame) return;
+        double ms = end - start;
+        
+        SSAOTraceCallStats& c = perCall[call];
+        c.calls++;
+        c.ms += ms;
+        frame.calls++;
+        frame.glMs += ms;
+        
+        if(redundant) {
+            c.redundant++;
+            if(CallSetsUniform(call)) frame.redundantUniforms++;
+            else frame.redundantBinds++;
+        }
+        
+        bool stall = CallStalls(call);
+        if(stall) frame.stalls++;
+        if(file) events.push_back({ CallName(call), stall ? "gl,stall" : "gl", start, ms, redundant });
+    }
+};
+
+static SSAOGLTracer ssaoGLTrace;
+
+// Times one wrapped call; the wrapper fills in redundant before returning
+struct SSAOTraceScope {
+    SSAOTraceCall call;
+    bool redundant = false;
+    double start;
+    
+    explicit SSAOTraceScope(SSAOTraceCall c) : call(c), start(ssaoGLTrace.Now()) {}
+    ~SSAOTraceScope() { ssaoGLTrace.Record(call, redundant, start, ssaoGLTrace.Now()); }
+};
+
+// ============================================================================
+// WRAPPERS
+// ============================================================================
+
+#define SSAO_TRACE(name) SSAOTraceScope scope(SSAO_CALL_##name)
+
+inline uint64_t SSAOTraceCapSlot(GLenum cap) {
+    switch(cap) {
+        case GL_DEPTH_TEST: return SSAO_STATE_DEPTH_TEST;
+        case GL_STENCIL_TEST: return SSAO_STATE_STENCIL_TEST;
+        case GL_BLEND: return SSAO_STATE_BLEND;
+        case GL_CULL_FACE: return SSAO_STATE_CULL_FACE;
+        case GL_SCISSOR_TEST: return SSAO_STATE_SCISSOR_TEST;
+        default: return SSAO_STATE_COUNT;
+    }
+}
+
+// Binds
+
+inline void SSAOTrace_glActiveTexture(GLenum texture) {
+    SSAO_TRACE(glActiveTexture);
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_ACTIVE_TEXTURE, texture - GL_TEXTURE0);
+    glActiveTexture(texture);
+}
+
+inline void SSAOTrace_glBindTexture(GLenum target, GLuint texture) {
+    SSAO_TRACE(glBindTexture);
+    if(target == GL_TEXTURE_2D) scope.redundant = ssaoGLTrace.SetTexture(texture);
+    glBindTexture(target, texture);
+}
+
+inline void SSAOTrace_glBindFramebuffer(GLenum target, GLuint framebuffer) {
+    SSAO_TRACE(glBindFramebuffer);
+    bool draw = target != GL_READ_FRAMEBUFFER;
+    bool read = target != GL_DRAW_FRAMEBUFFER;
+    bool redundant = true;
+    if(draw) redundant &= ssaoGLTrace.SetState(SSAO_STATE_DRAW_FRAMEBUFFER, framebuffer);
+    if(read) redundant &= ssaoGLTrace.SetState(SSAO_STATE_READ_FRAMEBUFFER, framebuffer);
+    scope.redundant = redundant;
+    glBindFramebuffer(target, framebuffer);
+}
+
+inline void SSAOTrace_glBindRenderbuffer(GLenum target, GLuint renderbuffer) {
+    SSAO_TRACE(glBindRenderbuffer);
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_RENDERBUFFER, renderbuffer);
+    glBindRenderbuffer(target, renderbuffer);
+}
+
+inline void SSAOTrace_glBindVertexArray(GLuint array) {
+    SSAO_TRACE(glBindVertexArray);
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_VERTEX_ARRAY, array);
+    glBindVertexArray(array);
+}
+
+inline void SSAOTrace_glUseProgram(GLuint program) {
+    SSAO_TRACE(glUseProgram);
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_PROGRAM, program);
+    glUseProgram(program);
+}
+
+// Fixed-function state
+
+inline void SSAOTrace_glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    SSAO_TRACE(glViewport);
+    GLint v[4] = { x, y, width, height };
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_VIEWPORT, SSAOGLTracer::Hash(v, sizeof(v)));
+    glViewport(x, y, width, height);
+}
+
+inline void SSAOTrace_glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    SSAO_TRACE(glScissor);
+    GLint v[4] = { x, y, width, height };
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_SCISSOR_BOX, SSAOGLTracer::Hash(v, sizeof(v)));
+    glScissor(x, y, width, height);
+}
+
+inline void SSAOTrace_glEnable(GLenum cap) {
+    SSAO_TRACE(glEnable);
+    uint64_t slot = SSAOTraceCapSlot(cap);
+    if(slot < SSAO_STATE_COUNT) scope.redundant = ssaoGLTrace.SetState((int)slot, 1);
+    glEnable(cap);
+}
+
+inline void SSAOTrace_glDisable(GLenum cap) {
+    SSAO_TRACE(glDisable);
+    uint64_t slot = SSAOTraceCapSlot(cap);
+    if(slot < SSAO_STATE_COUNT) scope.redundant = ssaoGLTrace.SetState((int)slot, 0);
+    glDisable(cap);
+}
+
+inline void SSAOTrace_glStencilFunc(GLenum func, GLint ref, GLuint mask) {
+    SSAO_TRACE(glStencilFunc);
+    uint64_t v[3] = { func, (uint64_t)ref, mask };
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_STENCIL_FUNC, SSAOGLTracer::Hash(v, sizeof(v)));
+    glStencilFunc(func, ref, mask);
+}
+
+inline void SSAOTrace_glStencilOp(GLenum fail, GLenum zfail, GLenum zpass) {
+    SSAO_TRACE(glStencilOp);
+    GLenum v[3] = { fail, zfail, zpass };
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_STENCIL_OP, SSAOGLTracer::Hash(v, sizeof(v)));
+    glStencilOp(fail, zfail, zpass);
+}
+
+inline void SSAOTrace_glStencilMask(GLuint mask) {
+    SSAO_TRACE(glStencilMask);
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_STENCIL_MASK, mask);
+    glStencilMask(mask);
+}
+
+inline void SSAOTrace_glColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a) {
+    SSAO_TRACE(glColorMask);
+    scope.redundant = ssaoGLTrace.SetState(SSAO_STATE_COLOR_MASK, r | g << 1 | b << 2 | a << 3);
+    glColorMask(r, g, b, a);
+}
+
+// Per-face stencil state does not fit the shadowed front-and-back slots,
+// so after these the next combined call is never counted as redundant
+
+inline void SSAOTrace_glStencilFuncSeparate(GLenum face, GLenum func, GLint ref, GLuint mask) {
+    SSAO_TRACE(glStencilFuncSeparate);
+    ssaoGLTrace.ForgetState(SSAO_STATE_STENCIL_FUNC);
+    glStencilFuncSeparate(face, func, ref, mask);
+}
+
+inline void SSAOTrace_glStencilOpSeparate(GLenum face, GLenum sfail, GLenum dpfail, GLenum dppass) {
+    SSAO_TRACE(glStencilOpSeparate);
+    ssaoGLTrace.ForgetState(SSAO_STATE_STENCIL_OP);
+    glStencilOpSeparate(face, sfail, dpfail, dppass);
+}
+
+inline void SSAOTrace_glStencilMaskSeparate(GLenum face, GLuint mask) {
+    SSAO_TRACE(glStencilMaskSeparate);
+    ssaoGLTrace.ForgetState(SSAO_STATE_STENCIL_MASK);
+    glStencilMaskSeparate(face, mask);
+}
+
+// Uniforms
+
+inline void SSAOTrace_glUniform1i(GLint location, GLint v0) {
+    SSAO_TRACE(glUniform1i);
+    scope.redundant = ssaoGLTrace.SetUniform(location, &v0, sizeof(v0));
+    glUniform1i(location, v0);
+}
+
+inline void SSAOTrace_glUniform1f(GLint location, GLfloat v0) {
+    SSAO_TRACE(glUniform1f);
+    scope.redundant = ssaoGLTrace.SetUniform(location, &v0, sizeof(v0));
+    glUniform1f(location, v0);
+}
+
+inline void SSAOTrace_glUniform2f(GLint location, GLfloat v0, GLfloat v1) {
+    SSAO_TRACE(glUniform2f);
+    GLfloat v[2] = { v0, v1 };
+    scope.redundant = ssaoGLTrace.SetUniform(location, v, sizeof(v));
+    glUniform2f(location, v0, v1);
+}
+
+inline void SSAOTrace_glUniform1fv(GLint location, GLsizei count, const GLfloat* value) {
+    SSAO_TRACE(glUniform1fv);
+    scope.redundant = ssaoGLTrace.SetUniform(location, value, sizeof(GLfloat) * count);
+    glUniform1fv(location, count, value);
+}
+
+inline void SSAOTrace_glUniform2fv(GLint location, GLsizei count, const GLfloat* value) {
+    SSAO_TRACE(glUniform2fv);
+    scope.redundant = ssaoGLTrace.SetUniform(location, value, sizeof(GLfloat) * 2 * count);
+    glUniform2fv(location, count, value);
+}
+
+inline void SSAOTrace_glUniform4fv(GLint location, GLsizei count, const GLfloat* value) {
+    SSAO_TRACE(glUniform4fv);
+    scope.redundant = ssaoGLTrace.SetUniform(location, value, sizeof(GLfloat) * 4 * count);
+    glUniform4fv(location, count, value);
+}
+
+inline void SSAOTrace_glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+    SSAO_TRACE(glUniformMatrix4fv);
+    scope.redundant = ssaoGLTrace.SetUniform(location, value, sizeof(GLfloat) * 16 * count);
+    glUniformMatrix4fv(location, count, transpose, value);
+}
+
+// Draws and attachment operations
+
+inline void SSAOTrace_glDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    SSAO_TRACE(glDrawArrays);
+    glDrawArrays(mode, first, count);
+}
+
+inline void SSAOTrace_glClearBufferfv(GLenum buffer, GLint drawbuffer, const GLfloat* value) {
+    SSAO_TRACE(glClearBufferfv);
+    glClearBufferfv(buffer, drawbuffer, value);
+}
+
+inline void SSAOTrace_glClearBufferfi(GLenum buffer, GLint drawbuffer, GLfloat depth, GLint stencil) {
+    SSAO_TRACE(glClearBufferfi);
+    glClearBufferfi(buffer, drawbuffer, depth, stencil);
+}
+
+inline void SSAOTrace_glInvalidateFramebuffer(GLenum target, GLsizei numAttachments, const GLenum* attachments) {
+    SSAO_TRACE(glInvalidateFramebuffer);
+    glInvalidateFramebuffer(target, numAttachments, attachments);
+}
+
+// Object lifetime and storage
+
+inline void SSAOTrace_glGenTextures(GLsizei n, GLuint* textures) {
+    SSAO_TRACE(glGenTextures);
+    glGenTextures(n, textures);
+}
+
+inline void SSAOTrace_glDeleteTextures(GLsizei n, const GLuint* textures) {
+    SSAO_TRACE(glDeleteTextures);
+    ssaoGLTrace.ForgetBindings(SSAO_STATE_TEXTURE0, 16);
+    glDeleteTextures(n, textures);
+}
+
+inline void SSAOTrace_glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                                   GLint border, GLenum format, GLenum type, const void* pixels) {
+    SSAO_TRACE(glTexImage2D);
+    glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+}
+
+inline void SSAOTrace_glTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height) {
+    SSAO_TRACE(glTexStorage2D);
+    glTexStorage2D(target, levels, internalformat, width, height);
+}
+
+inline void SSAOTrace_glTexParameteri(GLenum target, GLenum pname, GLint param) {
+    SSAO_TRACE(glTexParameteri);
+    glTexParameteri(target, pname, param);
+}
+
+inline void SSAOTrace_glCopyTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset,
+                                          GLint x, GLint y, GLsizei width, GLsizei height) {
+    SSAO_TRACE(glCopyTexSubImage2D);
+    glCopyTexSubImage2D(target, level, xoffset, yoffset, x, y, width, height);
+}
+
+inline void SSAOTrace_glGenFramebuffers(GLsizei n, GLuint* framebuffers) {
+    SSAO_TRACE(glGenFramebuffers);
+    glGenFramebuffers(n, framebuffers);
+}
+
+inline void SSAOTrace_glDeleteFramebuffers(GLsizei n, const GLuint* framebuffers) {
+    SSAO_TRACE(glDeleteFramebuffers);
+    ssaoGLTrace.ForgetState(SSAO_STATE_DRAW_FRAMEBUFFER);
+    ssaoGLTrace.ForgetState(SSAO_STATE_READ_FRAMEBUFFER);
+    glDeleteFramebuffers(n, framebuffers);
+}
+
+inline void SSAOTrace_glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {
+    SSAO_TRACE(glFramebufferTexture2D);
+    glFramebufferTexture2D(target, attachment, textarget, texture, level);
+}
+
+inline void SSAOTrace_glFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) {
+    SSAO_TRACE(glFramebufferRenderbuffer);
+    glFramebufferRenderbuffer(target, attachment, renderbuffertarget, renderbuffer);
+}
+
+inline void SSAOTrace_glGenRenderbuffers(GLsizei n, GLuint* renderbuffers) {
+    SSAO_TRACE(glGenRenderbuffers);
+    glGenRenderbuffers(n, renderbuffers);
+}
+
+inline void SSAOTrace_glDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers) {
+    SSAO_TRACE(glDeleteRenderbuffers);
+    ssaoGLTrace.ForgetState(SSAO_STATE_RENDERBUFFER);
+    glDeleteRenderbuffers(n, renderbuffers);
+}
+
+inline void SSAOTrace_glRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height) {
+    SSAO_TRACE(glRenderbufferStorage);
+    glRenderbufferStorage(target, internalformat, width, height);
+}
+
+inline void SSAOTrace_glDeleteProgram(GLuint program) {
+    SSAO_TRACE(glDeleteProgram);
+    ssaoGLTrace.ForgetProgram(program);
+    ssaoGLTrace.ForgetState(SSAO_STATE_PROGRAM);
+    glDeleteProgram(program);
+}
+
+// Queries that may stall
+
+inline void SSAOTrace_glGetIntegerv(GLenum pname, GLint* data) {
+    SSAO_TRACE(glGetIntegerv);
+    glGetIntegerv(pname, data);
+}
+
+inline void SSAOTrace_glGetBooleanv(GLenum pname, GLboolean* data) {
+    SSAO_TRACE(glGetBooleanv);
+    glGetBooleanv(pname, data);
+}
+
+inline GLboolean SSAOTrace_glIsEnabled(GLenum cap) {
+    SSAO_TRACE(glIsEnabled);
+    GLboolean enabled = glIsEnabled(cap);
+    uint64_t slot = SSAOTraceCapSlot(cap);
+    if(slot < SSAO_STATE_COUNT) ssaoGLTrace.SetState((int)slot, enabled ? 1 : 0);
+    return enabled;
+}
+
+inline GLenum SSAOTrace_glCheckFramebufferStatus(GLenum target) {
+    SSAO_TRACE(glCheckFramebufferStatus);
+    return glCheckFramebufferStatus(target);
+}
+
+inline void SSAOTrace_glGetShaderiv(GLuint shader, GLenum pname, GLint* params) {
+    SSAO_TRACE(glGetShaderiv);
+    glGetShaderiv(shader, pname, params);
+}
+
+inline void SSAOTrace_glGetProgramiv(GLuint program, GLenum pname, GLint* params) {
+    SSAO_TRACE(glGetProgramiv);
+    glGetProgramiv(program, pname, params);
+}
+
+inline void SSAOTrace_glGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog) {
+    SSAO_TRACE(glGetShaderInfoLog);
+    glGetShaderInfoLog(shader, bufSize, length, infoLog);
+}
+
+inline void SSAOTrace_glGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog) {
+    SSAO_TRACE(glGetProgramInfoLog);
+    glGetProgramInfoLog(program, bufSize, length, infoLog);
+}
+
+inline GLint SSAOTrace_glGetUniformLocation(GLuint program, const GLchar* name) {
+    SSAO_TRACE(glGetUniformLocation);
+    return glGetUniformLocation(program, name);
+}
+
+inline GLenum SSAOTrace_glGetError() {
+    SSAO_TRACE(glGetError);
+    return glGetError();
+}
+
+inline void SSAOTrace_glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels) {
+    SSAO_TRACE(glReadPixels);
+    glReadPixels(x, y, width, height, format, type, pixels);
+}
+
+inline void SSAOTrace_glFinish() {
+    SSAO_TRACE(glFinish);
+    glFinish();
+}
+
+#undef SSAO_TRACE
+
+// Route the traced entry points through the wrappers from here on
+#define glActiveTexture(...) SSAOTrace_glActiveTexture(__VA_ARGS__)
+#define glBindTexture(...) SSAOTrace_glBindTexture(__VA_ARGS__)
+#define glBindFramebuffer(...) SSAOTrace_glBindFramebuffer(__VA_ARGS__)
+#define glBindRenderbuffer(...) SSAOTrace_glBindRenderbuffer(__VA_ARGS__)
+#define glBindVertexArray(...) SSAOTrace_glBindVertexArray(__VA_ARGS__)
+#define glUseProgram(...) SSAOTrace_glUseProgram(__VA_ARGS__)
+#define glViewport(...) SSAOTrace_glViewport(__VA_ARGS__)
+#define glScissor(...) SSAOTrace_glScissor(__VA_ARGS__)
+#define glEnable(...) SSAOTrace_glEnable(__VA_ARGS__)
+#define glDisable(...) SSAOTrace_glDisable(__VA_ARGS__)
+#define glStencilFunc(...) SSAOTrace_glStencilFunc(__VA_ARGS__)
+#define glStencilOp(...) SSAOTrace_glStencilOp(__VA_ARGS__)
+#define glStencilMask(...) SSAOTrace_glStencilMask(__VA_ARGS__)
+#define glColorMask(...) SSAOTrace_glColorMask(__VA_ARGS__)
+#define glStencilFuncSeparate(...) SSAOTrace_glStencilFuncSeparate(__VA_ARGS__)
+#define glStencilOpSeparate(...) SSAOTrace_glStencilOpSeparate(__VA_ARGS__)
+#define glStencilMaskSeparate(...) SSAOTrace_glStencilMaskSeparate(__VA_ARGS__)
+#define glUniform1i(...) SSAOTrace_glUniform1i(__VA_ARGS__)
+#define glUniform1f(...) SSAOTrace_glUniform1f(__VA_ARGS__)
+#define glUniform2f(...) SSAOTrace_glUniform2f(__VA_ARGS__)
+#define glUniform1fv(...) SSAOTrace_glUniform1fv(__VA_ARGS__)
+#define glUniform2fv(...) SSAOTrace_glUniform2fv(__VA_ARGS__)
+#define glUniform4fv(...) SSAOTrace_glUniform4fv(__VA_ARGS__)
+#define glUniformMatrix4fv(...) SSAOTrace_glUniformMatrix4fv(__VA_ARGS__)
+#define glDrawArrays(...) SSAOTrace_glDrawArrays(__VA_ARGS__)
+#define glClearBufferfv(...) SSAOTrace_glClearBufferfv(__VA_ARGS__)
+#define glClearBufferfi(...) SSAOTrace_glClearBufferfi(__VA_ARGS__)
+#define glInvalidateFramebuffer(...) SSAOTrace_glInvalidateFramebuffer(__VA_ARGS__)
+#define glGenTextures(...) SSAOTrace_glGenTextures(__VA_ARGS__)
+#define glDeleteTextures(...) SSAOTrace_glDeleteTextures(__VA_ARGS__)
+#define glTexImage2D(...) SSAOTrace_glTexImage2D(__VA_ARGS__)
+#define glTexStorage2D(...) SSAOTrace_glTexStorage2D(__VA_ARGS__)
+#define glTexParameteri(...) SSAOTrace_glTexParameteri(__VA_ARGS__)
+#define glCopyTexSubImage2D(...) SSAOTrace_glCopyTexSubImage2D(__VA_ARGS__)
+#define glGenFramebuffers(...) SSAOTrace_glGenFramebuffers(__VA_ARGS__)
+#define glDeleteFramebuffers(...) SSAOTrace_glDeleteFramebuffers(__VA_ARGS__)
+#define glFramebufferTexture2D(...) SSAOTrace_glFramebufferTexture2D(__VA_ARGS__)
+#define glFramebufferRenderbuffer(...) SSAOTrace_glFramebufferRenderbuffer(__VA_ARGS__)
+#define glGenRenderbuffers(...) SSAOTrace_glGenRenderbuffers(__VA_ARGS__)
+#define glDeleteRenderbuffers(...) SSAOTrace_glDeleteRenderbuffers(__VA_ARGS__)
+#define glRenderbufferStorage(...) SSAOTrace_glRenderbufferStorage(__VA_ARGS__)
+#define glDeleteProgram(...) SSAOTrace_glDeleteProgram(__VA_ARGS__)
+#define glGetIntegerv(...) SSAOTrace_glGetIntegerv(__VA_ARGS__)
+#define glGetBooleanv(...) SSAOTrace_glGetBooleanv(__VA_ARGS__)
+#define glIsEnabled(...) SSAOTrace_glIsEnabled(__VA_ARGS__)
+#define glCheckFramebufferStatus(...) SSAOTrace_glCheckFramebufferStatus(__VA_ARGS__)
+#define glGetShaderiv(...) SSAOTrace_glGetShaderiv(__VA_ARGS__)
+#define glGetProgramiv(...) SSAOTrace_glGetProgramiv(__VA_ARGS__)
+#define glGetShaderInfoLog(...) SSAOTrace_glGetShaderInfoLog(__VA_ARGS__)
+#define glGetProgramInfoLog(...) SSAOTrace_glGetProgramInfoLog(__VA_ARGS__)
+#define glGetUniformLocation(...) SSAOTrace_glGetUniformLocation(__VA_ARGS__)
+#define glGetError(...) SSAOTrace_glGetError(__VA_ARGS__)
+#define glReadPixels(...) SSAOTrace_glReadPixels(__VA_ARGS__)
+#define glFinish(...) SSAOTrace_glFinish(__VA_ARGS__)
+
+#endif // SSAO_GL_TRACE
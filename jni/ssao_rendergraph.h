@@ -0,0 +1,468 @@
+#pragma once
+
+// ============================================================================
+// SSAO RENDER GRAPH
+// ============================================================================
+//
+// Per-frame pass list for the post-process chain. Every frame the passes
+// are declared with the textures they sample and the targets they draw
+// into, then Compile():
+//   - culls passes whose outputs nothing consumes. Sinks are passes that
+//     draw into an imported target (the game's framebuffer) or produce an
+//     exported texture.
+//   - maps transient textures onto pooled GL objects. Textures of the same
+//     format and size whose lifetimes do not overlap share one object.
+//   - plans framebuffer invalidates. Don't-care targets are invalidated
+//     before a pass draws, so tilers skip the load. Attachments are
+//     invalidated after their last use, so tilers skip the store.
+// Execute() then runs the surviving passes in declaration order.
+//
+// A pass may be limited to a scissor rect. Clears respect it, invalidates
+// do not: a scissored pass keeps the pixels outside the rect only when
+// its targets load KEEP or CLEAR.
+//
+// Pooled objects idle for RG_MAX_IDLE_FRAMES are deleted, so GPU memory
+// follows the current pass list rather than every stage ever enabled.
+
+#include <GLES3/gl3.h>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#define RG_MAX_IDLE_FRAMES 30
+
+enum RGFormat {
+    RG_R16F,
+    RG_RG16F,
+    RG_RGBA8,
+    RG_DEPTH24_STENCIL8, // renderbuffer, attachment only
+};
+
+enum RGLoad {
+    RG_LOAD_DONTCARE, // the pass covers every pixel, old contents are invalidated
+    RG_LOAD_CLEAR,    // cleared to the pass's clear value first
+    RG_LOAD_KEEP,     // old contents are used (stencil test, imported targets)
+};
+
+typedef int RGHandle; // index into RenderGraph::resources, -1 = none
+
+struct RenderGraph;
+
+struct RGResource {
+    const char* name;
+    RGFormat format;
+    int width, height;
+    bool imported;
+    bool exported;
+    bool framebuffer;   // imported render target, drawn through importedFBO
+    GLuint object;      // texture or renderbuffer, imported or from the pool
+    GLuint importedFBO; // may be 0, the default framebuffer
+    GLint viewport[4];
+    
+    // Compiled
+    int firstPass, lastPass;
+    int physical; // pool slot, -1 for imported
+};
+
+struct RGPass {
+    const char* name;
+    std::vector<RGHandle> reads;
+    RGHandle color = -1;
+    RGLoad colorLoad = RG_LOAD_DONTCARE;
+    float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    RGHandle depthStencil = -1;
+    RGLoad depthStencilLoad = RG_LOAD_DONTCARE;
+    bool scissor = false;
+    GLint scissorRect[4] = { 0, 0, 0, 0 };
+    std::function<void(const RenderGraph&)> execute;
+    
+    // Compiled
+    bool culled = false;
+    GLuint fbo = 0;
+    bool invalidateColorAfter = false;
+    bool invalidateDepthStencilAfter = false;
+    
+    RGPass& Read(RGHandle h) {
+        if(h >= 0) reads.push_back(h);
+        return *this;
+    }
+    
+    RGPass& Write(RGHandle h, RGLoad load, float clearValue = 0.0f) {
+        color = h;
+        colorLoad = load;
+        for(float& c : clearColor) c = clearValue;
+        return *this;
+    }
+    
+    RGPass& Attach(RGHandle h, RGLoad load) {
+        depthStencil = h;
+        depthStencilLoad = load;
+        return *this;
+    }
+    
+    // x, y, width, height in target pixels; null draws the whole target
+    RGPass& Scissor(const GLint* rect) {
+        scissor = rect != nullptr;
+        if(rect)
+            for(int i = 0; i < 4; i++) scissorRect[i] = rect[i];
+        return *this;
+    }
+};
+
+struct RGPhysical {
+    RGFormat format;
+    int width, height;
+    GLuint object;
+    int busyUntil;  // last pass of the current occupant while compiling
+    int idleFrames;
+    bool retained;  // exported last frame, not reused until nobody imports it
+};
+
+struct RGFramebuffer {
+    GLuint color, depthStencil;
+    GLuint fbo;
+};
+
+struct RenderGraph {
+    std::vector<RGResource> resources;
+    std::vector<RGPass> passes;
+    std::vector<RGPhysical> pool;
+    std::vector<RGFramebuffer> framebuffers;
+    
+    void (*passHook)(const char*) = nullptr; // called with each pass name
+    bool poolChanged = false;                // objects created or deleted this frame
+    
+    // ------------------------------------------------------------------------
+    // Declaration
+    // ------------------------------------------------------------------------
+    
+    void Reset() {
+        resources.clear();
+        passes.clear();
+    }
+    
+    RGHandle Create(const char* name, RGFormat format, int width, int height) {
+        RGResource r = {};
+        r.name = name;
+        r.format = format;
+        r.width = width;
+        r.height = height;
+        r.physical = -1;
+        resources.push_back(r);
+        return (RGHandle)resources.size() - 1;
+    }
+    
+    RGHandle ImportTexture(const char* name, GLuint texture, int width, int height) {
+        RGHandle h = Create(name, RG_R16F, width, height);
+        resources[h].imported = true;
+        resources[h].object = texture;
+        return h;
+    }
+    
+    RGHandle ImportFramebuffer(const char* name, GLuint fbo, const GLint viewport[4]) {
+        RGHandle h = Create(name, RG_RGBA8, viewport[2], viewport[3]);
+        RGResource& r = resources[h];
+        r.imported = true;
+        r.framebuffer = true;
+        r.importedFBO = fbo;
+        for(int i = 0; i < 4; i++) r.viewport[i] = viewport[i];
+        return h;
+    }
+    
+    // The object behind h outlives the frame; read it next frame through
+    // ImportTexture(Texture(h))
+    void Export(RGHandle h) {
+        resources[h].exported = true;
+    }
+    
+    RGPass& AddPass(const char* name, std::function<void(const RenderGraph&)> execute) {
+        RGPass p;
+        p.name = name;
+        p.execute = std::move(execute);
+        passes.push_back(std::move(p));
+        return passes.back();
+    }
+    
+    GLuint Texture(RGHandle h) const {
+        return h >= 0 ? resources[h].object : 0;
+    }
+    
+    // ------------------------------------------------------------------------
+    // Compilation
+    // ------------------------------------------------------------------------
+    
+    bool Compile() {
+        poolChanged = false;
+        Cull();
+        ComputeLifetimes();
+        
+        // Last frame's export stays untouched while this frame imports it
+        for(RGPhysical& p : pool) {
+            if(!p.retained) continue;
+            p.retained = false;
+            for(const RGResource& r : resources)
+                if(r.imported && r.object == p.object) p.retained = true;
+        }
+        for(RGPhysical& p : pool) p.busyUntil = -1;
+        
+        std::vector<bool> used(pool.size(), false);
+        for(int i = 0; i < (int)passes.size(); i++) {
+            if(passes[i].culled) continue;
+            for(RGResource& r : resources) {
+                if(r.imported || r.firstPass != i) continue;
+                r.physical = Allocate(r, i);
+                if(r.physical < 0) return false;
+                r.object = pool[r.physical].object;
+                if(r.physical >= (int)used.size()) used.resize(r.physical + 1, false);
+                used[r.physical] = true;
+            }
+        }
+        
+        for(int i = 0; i < (int)passes.size(); i++) {
+            RGPass& p = passes[i];
+            if(p.culled) continue;
+            if(!BindTargets(p)) return false;
+            
+            // Nothing reads these after this pass
+            p.invalidateColorAfter = p.color >= 0 && IsTransientEnd(p.color, i);
+            p.invalidateDepthStencilAfter = p.depthStencil >= 0 && IsTransientEnd(p.depthStencil, i);
+        }
+        
+        ReleaseIdle(used);
+        return true;
+    }
+    
+    void Execute() {
+        for(RGPass& p : passes) {
+            if(p.culled) continue;
+            if(passHook) passHook(p.name);
+            
+            glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+            const RGResource& target = resources[p.color >= 0 ? p.color : p.depthStencil];
+            if(target.framebuffer)
+                glViewport(target.viewport[0], target.viewport[1], target.viewport[2], target.viewport[3]);
+            else
+                glViewport(0, 0, target.width, target.height);
+            
+            if(p.scissor) {
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(p.scissorRect[0], p.scissorRect[1], p.scissorRect[2], p.scissorRect[3]);
+            }
+            
+            GLenum discard[2];
+            GLsizei discardCount = 0;
+            
+            if(p.color >= 0 && !resources[p.color].framebuffer) {
+                if(p.colorLoad == RG_LOAD_CLEAR)
+                    glClearBufferfv(GL_COLOR, 0, p.clearColor);
+                else if(p.colorLoad == RG_LOAD_DONTCARE)
+                    discard[discardCount++] = GL_COLOR_ATTACHMENT0;
+            }
+            if(p.depthStencil >= 0) {
+                if(p.depthStencilLoad == RG_LOAD_CLEAR) {
+                    glStencilMask(0xFF);
+                    glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+                } else if(p.depthStencilLoad == RG_LOAD_DONTCARE) {
+                    discard[discardCount++] = GL_DEPTH_STENCIL_ATTACHMENT;
+                }
+            }
+            if(discardCount) glInvalidateFramebuffer(GL_FRAMEBUFFER, discardCount, discard);
+            
+            p.execute(*this);
+            
+            discardCount = 0;
+            if(p.invalidateColorAfter) discard[discardCount++] = GL_COLOR_ATTACHMENT0;
+            if(p.invalidateDepthStencilAfter) discard[discardCount++] = GL_DEPTH_STENCIL_ATTACHMENT;
+            if(discardCount) glInvalidateFramebuffer(GL_FRAMEBUFFER, discardCount, discard);
+            
+            if(p.scissor) glDisable(GL_SCISSOR_TEST);
+        }
+        
+        for(const RGResource& r : resources)
+            if(r.exported && r.physical >= 0) pool[r.physical].retained = true;
+    }
+    
+    // Bytes held by pooled objects, for logging
+    size_t PoolBytes() const {
+        size_t total = 0;
+        for(const RGPhysical& p : pool)
+            total += (size_t)p.width * p.height * (p.format == RG_R16F ? 2 : 4);
+        return total;
+    }
+    
+    void Release() {
+        for(RGFramebuffer& f : framebuffers) glDeleteFramebuffers(1, &f.fbo);
+        for(RGPhysical& p : pool) DeleteObject(p);
+        framebuffers.clear();
+        pool.clear();
+        Reset();
+    }
+
+private:
+    // Walk backwards from the sinks; a pass survives if a surviving later
+    // pass consumes something it writes
+    void Cull() {
+        std::vector<bool> needed(resources.size(), false);
+        for(size_t i = 0; i < resources.size(); i++)
+            needed[i] = resources[i].exported;
+        
+        for(int i = (int)passes.size() - 1; i >= 0; i--) {
+            RGPass& p = passes[i];
+            bool sink = p.color >= 0 && resources[p.color].imported;
+            bool live = sink ||
+                        (p.color >= 0 && needed[p.color]) ||
+                        (p.depthStencil >= 0 && needed[p.depthStencil]);
+            p.culled = !live;
+            if(!live) continue;
+            
+            // Everything this pass consumes must be produced earlier
+            if(p.color >= 0) needed[p.color] = false;
+            if(p.depthStencil >= 0) needed[p.depthStencil] = false;
+            for(RGHandle r : p.reads) needed[r] = true;
+            if(p.depthStencil >= 0 && p.depthStencilLoad == RG_LOAD_KEEP) needed[p.depthStencil] = true;
+            if(p.color >= 0 && p.colorLoad == RG_LOAD_KEEP) needed[p.color] = true;
+        }
+    }
+    
+    void ComputeLifetimes() {
+        for(RGResource& r : resources) {
+            r.firstPass = r.lastPass = -1;
+            if(!r.imported) r.physical = -1;
+        }
+        
+        for(int i = 0; i < (int)passes.size(); i++) {
+            const RGPass& p = passes[i];
+            if(p.culled) continue;
+            
+            RGHandle touched[2] = { p.color, p.depthStencil };
+            for(RGHandle h : touched) {
+                if(h < 0) continue;
+                if(resources[h].firstPass < 0) resources[h].firstPass = i;
+                resources[h].lastPass = i;
+            }
+            for(RGHandle h : p.reads) {
+                if(resources[h].firstPass < 0) resources[h].firstPass = i;
+                resources[h].lastPass = i;
+            }
+        }
+        
+        for(RGResource& r : resources)
+            if(r.exported) r.lastPass = (int)passes.size();
+    }
+    
+    bool IsTransientEnd(RGHandle h, int pass) const {
+        const RGResource& r = resources[h];
+        return !r.imported && !r.exported && r.lastPass == pass;
+    }
+    
+    int Allocate(const RGResource& r, int pass) {
+        for(int i = 0; i < (int)pool.size(); i++) {
+            RGPhysical& p = pool[i];
+            if(p.retained || p.busyUntil >= pass) continue;
+            if(p.format != r.format || p.width != r.width || p.height != r.height) continue;
+            p.busyUntil = r.lastPass;
+            p.idleFrames = 0;
+            return i;
+        }
+        
+        RGPhysical p = {};
+        p.format = r.format;
+        p.width = r.width;
+        p.height = r.height;
+        p.busyUntil = r.lastPass;
+        p.object = CreateObject(r.format, r.width, r.height);
+        if(!p.object) return -1;
+        
+        pool.push_back(p);
+        poolChanged = true;
+        return (int)pool.size() - 1;
+    }
+    
+    static GLuint CreateObject(RGFormat format, int width, int height) {
+        GLuint object = 0;
+        if(format == RG_DEPTH24_STENCIL8) {
+            glGenRenderbuffers(1, &object);
+            glBindRenderbuffer(GL_RENDERBUFFER, object);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            return object;
+        }
+        
+        glGenTextures(1, &object);
+        glBindTexture(GL_TEXTURE_2D, object);
+        GLenum internalFormat = format == RG_R16F ? GL_R16F : format == RG_RG16F ? GL_RG16F : GL_RGBA8;
+        glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return object;
+    }
+    
+    static void DeleteObject(RGPhysical& p) {
+        if(p.format == RG_DEPTH24_STENCIL8) glDeleteRenderbuffers(1, &p.object);
+        else glDeleteTextures(1, &p.object);
+        p.object = 0;
+    }
+    
+    bool BindTargets(RGPass& p) {
+        if(p.color >= 0 && resources[p.color].framebuffer) {
+            p.fbo = resources[p.color].importedFBO;
+            return true;
+        }
+        
+        GLuint color = p.color >= 0 ? resources[p.color].object : 0;
+        GLuint depthStencil = p.depthStencil >= 0 ? resources[p.depthStencil].object : 0;
+        for(const RGFramebuffer& f : framebuffers) {
+            if(f.color == color && f.depthStencil == depthStencil) {
+                p.fbo = f.fbo;
+                return true;
+            }
+        }
+        
+        RGFramebuffer f = { color, depthStencil, 0 };
+        glGenFramebuffers(1, &f.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, f.fbo);
+        if(color)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        if(depthStencil)
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                                      GL_RENDERBUFFER, depthStencil);
+        
+        // An incomplete combination is not cached; the next compile retries it
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            glDeleteFramebuffers(1, &f.fbo);
+            p.fbo = 0;
+            return false;
+        }
+        framebuffers.push_back(f);
+        p.fbo = f.fbo;
+        return true;
+    }
+    
+    // Deletes pool objects (and framebuffers using them) that have sat
+    // unused for RG_MAX_IDLE_FRAMES
+    void ReleaseIdle(const std::vector<bool>& used) {
+        for(int i = (int)pool.size() - 1; i >= 0; i--) {
+            RGPhysical& p = pool[i];
+            if((i < (int)used.size() && used[i]) || p.retained) continue;
+            if(++p.idleFrames <= RG_MAX_IDLE_FRAMES) continue;
+            
+            for(int f = (int)framebuffers.size() - 1; f >= 0; f--) {
+                if(framebuffers[f].color == p.object || framebuffers[f].depthStencil == p.object) {
+                    glDeleteFramebuffers(1, &framebuffers[f].fbo);
+                    framebuffers.erase(framebuffers.begin() + f);
+                }
+            }
+            DeleteObject(p);
+            pool.erase(pool.begin() + i);
+            poolChanged = true;
+            
+            // Slots above i moved down; compiled handles into the pool are
+            // fixed up so Execute() marks the right exports
+            for(RGResource& r : resources)
+                if(r.physical > i) r.physical--;
+        }
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+// Off-screen GLES 3 context for the desktop tools. Uses an EGL pbuffer
+// with an RGBA8 color buffer like the game's, on Mesa the surfaceless
+// platform is picked unless EGL_PLATFORM is already set.
+
+#include <EGL/egl.h>
+#include <cstdio>
+#include <cstdlib>
+
+struct HeadlessGL {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+    
+    bool Create(int width, int height, int minorVersion = 0) {
+        setenv("EGL_PLATFORM", "surfaceless", 0);
+        
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+            fprintf(stderr, "error: no EGL display\n");
+            return false;
+        }
+        
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint count = 0;
+        if(!eglChooseConfig(display, configAttribs, &config, 1, &count) || count == 0) {
+            fprintf(stderr, "error: no RGBA8 GLES 3 pbuffer config\n");
+            return false;
+        }
+        
+        eglBindAPI(EGL_OPENGL_ES_API);
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, minorVersion,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        
+        const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+        
+        if(context == EGL_NO_CONTEXT || surface == EGL_NO_SURFACE ||
+           !eglMakeCurrent(display, surface, surface, context)) {
+            fprintf(stderr, "error: failed to create GLES 3.%d context\n", minorVersion);
+            return false;
+        }
+        return true;
+    }
+    
+    void Destroy() {
+        if(display == EGL_NO_DISPLAY) return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if(surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+        if(context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+    }
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+// Minimal stand-in for the AndroidModLoader interface so the mod source
+// builds as part of the desktop tools. Hooks are never installed.
+
+#include <cstdint>
+
+#define MYMOD(id, name, version, author)
+#define NEEDGAME(package)
+
+struct IAML {
+    void Redirect(uintptr_t, uintptr_t) {}
+};
+
+inline IAML g_headlessAML;
+inline IAML* aml = &g_headlessAML;
@@ -0,0 +1,69 @@
+#pragma once
+
+// In-memory config with the same Bind/Get surface as the AML one. Tools
+// override values with Set() or a "Key=Value;..." list via Apply().
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+struct ConfigEntry {
+    std::string value;
+    
+    bool GetBool() { return value == "true" || atoi(value.c_str()) != 0; }
+    int GetInt() { return atoi(value.c_str()); }
+    float GetFloat() { return (float)atof(value.c_str()); }
+    const char* GetString() { return value.c_str(); }
+    
+    void SetString(const char* v) { value = v; }
+    void SetBool(bool v) { value = v ? "1" : "0"; }
+    void SetInt(int v) { value = std::to_string(v); }
+    void SetFloat(float v) { value = std::to_string(v); }
+};
+
+struct Config {
+    std::map<std::string, ConfigEntry> entries;
+    
+    ConfigEntry* Bind(const char* key, const char* def, const char* = nullptr) {
+        ConfigEntry& e = entries[key];
+        e.value = def;
+        return &e;
+    }
+    ConfigEntry* Bind(const char* key, bool def, const char* desc = nullptr) {
+        return Bind(key, def ? "1" : "0", desc);
+    }
+    ConfigEntry* Bind(const char* key, int def, const char* desc = nullptr) {
+        return Bind(key, std::to_string(def).c_str(), desc);
+    }
+    ConfigEntry* Bind(const char* key, float def, const char* desc = nullptr) {
+        return Bind(key, std::to_string(def).c_str(), desc);
+    }
+    void Save() {}
+    
+    // Returns false for keys the mod never bound
+    bool Set(const char* key, const char* value) {
+        auto it = entries.find(key);
+        if(it == entries.end()) return false;
+        it->second.value = value;
+        return true;
+    }
+    
+    // "Key=Value;Key=Value", unknown keys are skipped
+    void Apply(const char* list) {
+        std::string all = list;
+        size_t pos = 0;
+        while(pos < all.size()) {
+            size_t end = all.find_first_of(";\n", pos);
+            if(end == std::string::npos) end = all.size();
+            std::string item = all.substr(pos, end - pos);
+            size_t eq = item.find('=');
+            if(eq != std::string::npos)
+                Set(item.substr(0, eq).c_str(), item.substr(eq + 1).c_str());
+            pos = end + 1;
+        }
+    }
+};
+
+inline Config g_headlessConfig;
+inline Config* cfg = &g_headlessConfig;
@@ -0,0 +1,34 @@
+#pragma once
+
+// Desktop logger: everything goes to stderr, Info can be silenced by tools
+// that print their own reports.
+
+#include <cstdarg>
+#include <cstdio>
+
+struct Logger {
+    bool quiet = false;
+    
+    void SetTag(const char*) {}
+    
+    void Info(const char* fmt, ...) {
+        if(quiet) return;
+        va_list args;
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        fputc('\n', stderr);
+        va_end(args);
+    }
+    
+    void Error(const char* fmt, ...) {
+        va_list args;
+        va_start(args, fmt);
+        fputs("error: ", stderr);
+        vfprintf(stderr, fmt, args);
+        fputc('\n', stderr);
+        va_end(args);
+    }
+};
+
+inline Logger g_headlessLogger;
+inline Logger* logger = &g_headlessLogger;
@@ -0,0 +1,245 @@
+#pragma once
+
+// Scenes for the desktop tools: captured frames (CaptureFrames) and
+// built-in synthetic ones ray cast from boxes, plus rendering a scene
+// through the mod and reading back its AO. Include after SSAO_Complete.cpp.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// SCENES
+// ============================================================================
+
+struct Box {
+    float min[3], max[3];
+};
+
+struct Scene {
+    std::string name;
+    int width, height;
+    int depthBits;
+    const void* depth;
+    std::vector<unsigned int> ownedDepth; // synthetic scenes only
+    std::vector<Box> boxes;               // synthetic scenes only
+    float eye[3], yaw, pitch;             // synthetic scenes only
+    float view[16], proj[16];
+    float nearPlane, farPlane;
+};
+
+// Slab test, returns the entry distance or -1
+inline float IntersectBox(const Box& b, const float* o, const float* d) {
+    float tMin = 0.0f, tMax = 1e30f;
+    for(int a = 0; a < 3; a++) {
+        if(fabsf(d[a]) < 1e-8f) {
+            if(o[a] < b.min[a] || o[a] > b.max[a]) return -1.0f;
+            continue;
+        }
+        float t0 = (b.min[a] - o[a]) / d[a];
+        float t1 = (b.max[a] - o[a]) / d[a];
+        if(t0 > t1) std::swap(t0, t1);
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+        if(tMin > tMax) return -1.0f;
+    }
+    return tMin;
+}
+
+// Ray casts a ground plane (y = 0) and the scene's boxes into a 24-bit
+// style depth buffer, from a camera at eye looking along yaw/pitch. Can
+// be called again after moving the camera.
+inline void BuildSyntheticScene(Scene& s) {
+    const float* pos = s.eye;
+    const float fovY = 1.2f;
+    float aspect = (float)s.width / s.height;
+    float n = s.nearPlane, f = s.farPlane;
+    
+    memset(s.proj, 0, sizeof(s.proj));
+    s.proj[5] = 1.0f / tanf(fovY * 0.5f);
+    s.proj[0] = s.proj[5] / aspect;
+    s.proj[10] = -(f + n) / (f - n);
+    s.proj[11] = -1.0f;
+    s.proj[14] = -2.0f * f * n / (f - n);
+    
+    // Camera to world: yaw about Y, then pitch about X
+    float cy = cosf(s.yaw), sy = sinf(s.yaw), cp = cosf(s.pitch), sp = sinf(s.pitch);
+    float cam[16] = {
+        cy,       0.0f, -sy,      0.0f,
+        sy * sp,  cp,   cy * sp,  0.0f,
+        sy * cp, -sp,   cy * cp,  0.0f,
+        pos[0],   pos[1], pos[2], 1.0f
+    };
+    Matrix4x4Invert(cam, s.view);
+    
+    s.depthBits = 24;
+    s.ownedDepth.resize((size_t)s.width * s.height);
+    float tanY = tanf(fovY * 0.5f), tanX = tanY * aspect;
+    
+    for(int y = 0; y < s.height; y++) {
+        for(int x = 0; x < s.width; x++) {
+            float vx = ((x + 0.5f) / s.width * 2.0f - 1.0f) * tanX;
+            float vy = ((y + 0.5f) / s.height * 2.0f - 1.0f) * tanY;
+            float dir[3];
+            for(int a = 0; a < 3; a++)
+                dir[a] = cam[a] * vx + cam[4 + a] * vy - cam[8 + a];
+            
+            float t = 1e30f;
+            if(dir[1] < -1e-6f) t = -pos[1] / dir[1];
+            for(const Box& b : s.boxes) {
+                float bt = IntersectBox(b, pos, dir);
+                if(bt > 0.0f && bt < t) t = bt;
+            }
+            
+            // View space z of the hit is -t since dir has unit view z
+            float depth = 1.0f;
+            if(t < f) {
+                float z = -t;
+                float ndc = (s.proj[10] * z + s.proj[14]) / -z;
+                depth = std::min(1.0f, std::max(0.0f, ndc * 0.5f + 0.5f));
+            }
+            s.ownedDepth[(size_t)y * s.width + x] = (unsigned int)(depth * 4294967295.0);
+        }
+    }
+    s.depth = s.ownedDepth.data();
+}
+
+inline void AddBox(std::vector<Box>& boxes, float x0, float y0, float z0,
+                   float x1, float y1, float z1) {
+    boxes.push_back({ { x0, y0, z0 }, { x1, y1, z1 } });
+}
+
+inline void MakeSyntheticScenes(std::vector<Scene>& scenes, int width, int height) {
+    scenes.resize(3);
+    for(Scene& s : scenes) {
+        s.width = width;
+        s.height = height;
+        s.nearPlane = 0.3f;
+        s.farPlane = 800.0f;
+    }
+    
+    // Downtown street: facades on both sides, parked cars, a bus stop
+    {
+        std::vector<Box> boxes;
+        for(int i = 0; i < 12; i++) {
+            float z = -10.0f - i * 18.0f;
+            AddBox(boxes, -22.0f, 0.0f, z - 15.0f, -8.0f, 20.0f + (i % 3) * 12.0f, z);
+            AddBox(boxes, 8.0f, 0.0f, z - 16.0f, 24.0f, 14.0f + (i % 4) * 9.0f, z);
+            AddBox(boxes, -6.5f, 0.0f, z - 7.0f, -4.7f, 1.5f, z - 2.5f);
+            AddBox(boxes, 4.5f, 0.0f, z - 12.0f, 6.3f, 1.4f, z - 7.5f);
+        }
+        AddBox(boxes, -8.0f, 0.0f, -16.0f, -6.8f, 2.6f, -13.0f);
+        float pos[3] = { 0.5f, 1.7f, 0.0f };
+        scenes[0].name = "synthetic-street";
+        scenes[0].boxes = std::move(boxes);
+        memcpy(scenes[0].eye, pos, sizeof(pos));
+        scenes[0].yaw = 0.15f;
+        scenes[0].pitch = -0.05f;
+        BuildSyntheticScene(scenes[0]);
+    }
+    
+    // Dense clutter: foliage-like field of small blocks
+    {
+        std::vector<Box> boxes;
+        unsigned int seed = 1234567u;
+        auto rnd = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return (seed >> 8) / 16777216.0f;
+        };
+        for(int i = 0; i < 400; i++) {
+            float x = (rnd() - 0.5f) * 80.0f;
+            float z = -3.0f - rnd() * 90.0f;
+            float w = 0.3f + rnd() * 1.5f, h = 0.3f + rnd() * 3.0f;
+            AddBox(boxes, x, 0.0f, z, x + w, h, z + w);
+        }
+        float pos[3] = { 0.0f, 2.2f, 0.0f };
+        scenes[1].name = "synthetic-clutter";
+        scenes[1].boxes = std::move(boxes);
+        memcpy(scenes[1].eye, pos, sizeof(pos));
+        scenes[1].yaw = 0.0f;
+        scenes[1].pitch = -0.2f;
+        BuildSyntheticScene(scenes[1]);
+    }
+    
+    // Countryside: mostly sky and far field, a farmhouse and fences
+    {
+        std::vector<Box> boxes;
+        AddBox(boxes, -15.0f, 0.0f, -60.0f, 5.0f, 9.0f, -45.0f);
+        AddBox(boxes, 8.0f, 0.0f, -40.0f, 14.0f, 4.0f, -34.0f);
+        for(int i = 0; i < 30; i++)
+            AddBox(boxes, -30.0f + i * 2.0f, 0.0f, -20.0f, -29.8f + i * 2.0f, 1.2f, -19.8f);
+        AddBox(boxes, -200.0f, 0.0f, -400.0f, 150.0f, 40.0f, -300.0f);
+        float pos[3] = { 0.0f, 1.8f, 0.0f };
+        scenes[2].name = "synthetic-countryside";
+        scenes[2].boxes = std::move(boxes);
+        memcpy(scenes[2].eye, pos, sizeof(pos));
+        scenes[2].yaw = -0.1f;
+        scenes[2].pitch = 0.02f;
+        BuildSyntheticScene(scenes[2]);
+    }
+}
+
+inline bool LoadCaptureScene(std::vector<Scene>& scenes, SSAOCaptureReader& reader,
+                             const char* path) {
+    SSAOCaptureView view;
+    if(!reader.Open(path) || !reader.Next(view)) {
+        logger->Error("Cannot read capture %s", path);
+        return false;
+    }
+    
+    const SSAOCaptureFrame& f = *view.frame;
+    if(f.width != f.targetWidth || f.height != f.targetHeight) {
+        logger->Error("%s: depth and color size differ, skipped", path);
+        return false;
+    }
+    
+    Scene s;
+    s.name = path;
+    s.width = f.width;
+    s.height = f.height;
+    s.depthBits = f.depthBits;
+    s.depth = view.depth;
+    memcpy(s.view, f.viewMatrix, sizeof(s.view));
+    memcpy(s.proj, f.projMatrix, sizeof(s.proj));
+    s.nearPlane = f.nearPlane;
+    s.farPlane = f.farPlane;
+    scenes.push_back(std::move(s));
+    return true;
+}
+
+// ============================================================================
+// RENDERING
+// ============================================================================
+
+inline void RenderScene(const Scene& s) {
+    SSAOFrameInput in;
+    in.depthPixels = s.depth;
+    in.depthWidth = s.width;
+    in.depthHeight = s.height;
+    in.depthBits = s.depthBits;
+    in.viewMatrix = s.view;
+    in.projMatrix = s.proj;
+    in.nearPlane = s.nearPlane;
+    in.farPlane = s.farPlane;
+    in.width = s.width;
+    in.height = s.height;
+    RenderSSAOFrame(in);
+}
+
+inline std::vector<unsigned char> ReadAO(int width, int height) {
+    std::vector<unsigned char> rgba((size_t)width * height * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    std::vector<unsigned char> ao((size_t)width * height);
+    for(size_t i = 0; i < ao.size(); i++) ao[i] = rgba[i * 4];
+    return ao;
+}
+
+inline double PSNR(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
+    double mse = 0.0;
+    for(size_t i = 0; i < a.size(); i++) {
+        double d = (double)a[i] - b[i];
+        mse += d * d;
+    }
+    mse /= a.size();
+    return mse <= 1e-10 ? 99.0 : 10.0 * log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,137 @@
+// ============================================================================
+// SSAO AMORTIZED UPDATE CHECK
+// ============================================================================
+//
+// Drives the AmortizeRegions scheduler with camera motion on the synthetic
+// scenes and counts how many bands each frame recomputes. A slow pan
+// (1 degree per frame) and driving forward (15 m/s at 60 fps) must stay at
+// one band per frame after the first; scene cuts must recompute the whole
+// target, but no more than once per cycle of bands while they keep coming.
+//
+// Build (Linux, any EGL with GLES 3, e.g. Mesa llvmpipe):
+//   g++ -std=c++17 -O2 -Itools/headless -Ijni tools/ssao_amortize_check.cpp
+//       -o ssao_amortize_check -lEGL -lGLESv2 -ldl
+//
+// Usage:
+//   ssao_amortize_check [--size WxH] [--frames N] [Key=Value ...]
+//
+// AmortizeRegions defaults to 4. Exits with 1 if any run recomputes more
+// than the scheduler should.
+
+#include "SSAO_Complete.cpp"
+#include "headless_gl.h"
+#include "ssao_scenes.h"
+
+#define CHECK_PAN_RADIANS 0.01745f // per frame
+#define CHECK_DRIVE_METERS 0.25f   // per frame
+
+// Bands recomputed by the last frame: the whole target leaves every age at 0
+static int FreshBands() {
+    int fresh = 0;
+    for(int r = 0; r < amortizer.regions; r++)
+        if(amortizer.age[r] == 0) fresh++;
+    return fresh;
+}
+
+// Full recomputes and the oldest band over a run, frame 0 excluded
+struct RunStats {
+    int frames = 0;
+    int full = 0;
+    int maxAge = 0;
+    
+    void Add() {
+        if(frames++ == 0) return;
+        if(FreshBands() == amortizer.regions) full++;
+        for(int r = 0; r < amortizer.regions; r++)
+            maxAge = std::max(maxAge, amortizer.age[r]);
+    }
+};
+
+int main(int argc, char** argv) {
+    int width = 320, height = 180;
+    int frames = 48;
+    std::vector<const char*> overrides;
+    
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--size") && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if(strchr(argv[i], '=')) {
+            overrides.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "usage: %s [--size WxH] [--frames N] [Key=Value ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    OnModPreLoad();
+    cfg->Set("AmortizeRegions", "4");
+    for(const char* o : overrides) cfg->Apply(o);
+    cfg->Set("DebugMode", "1");
+    cfg->Set("StaticReuse", "0");
+    cfg->Set("Checkerboard", "0");
+    
+    int regions = pAmortizeRegions->GetInt();
+    if(regions < 2) {
+        logger->Error("AmortizeRegions must be at least 2");
+        return 1;
+    }
+    
+    std::vector<Scene> scenes;
+    MakeSyntheticScenes(scenes, width, height);
+    
+    HeadlessGL gl;
+    if(!gl.Create(width, height)) return 1;
+    
+    logger->quiet = true;
+    if(!InitShaders() || !InitGeometry()) {
+        logger->Error("Failed to initialize the SSAO pipeline");
+        return 1;
+    }
+    printf("%d bands, %d frames per run\n\n", regions, frames);
+    printf("%-24s %-6s  full recomputes  oldest band\n", "scene", "motion");
+    
+    bool ok = true;
+    glViewport(0, 0, width, height);
+    for(const Scene& original : scenes) {
+        const char* motions[] = { "pan", "drive" };
+        for(int m = 0; m < 2; m++) {
+            Scene s = original;
+            RunStats stats;
+            ResetFrameHistory();
+            for(int f = 0; f < frames; f++) {
+                if(m == 0) {
+                    s.yaw += CHECK_PAN_RADIANS;
+                } else {
+                    s.eye[0] -= sinf(s.yaw) * CHECK_DRIVE_METERS;
+                    s.eye[2] -= cosf(s.yaw) * CHECK_DRIVE_METERS;
+                }
+                BuildSyntheticScene(s);
+                RenderScene(s);
+                stats.Add();
+            }
+            
+            bool pass = stats.full == 0;
+            if(!pass) ok = false;
+            printf("%-24s %-6s %16d %12d%s\n", s.name.c_str(), motions[m], stats.full, stats.maxAge,
+                   pass ? "" : "  FAIL");
+        }
+    }
+    
+    // A cut every frame: the first one recomputes everything, later ones
+    // only once the bands of the previous full frame came round
+    int cutFull = 0;
+    for(int f = 0; f < frames; f++) {
+        RenderScene(scenes[f % 2]);
+        if(FreshBands() == regions) cutFull++;
+    }
+    int allowed = (frames + regions) / (regions + 1);
+    bool pass = cutFull >= std::min(2, allowed) && cutFull <= allowed;
+    if(!pass) ok = false;
+    printf("\ncuts every frame: %d full recomputes in %d frames, %d expected%s\n",
+           cutFull, frames, allowed, pass ? "" : "  FAIL");
+    
+    printf("\n%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,345 @@
+// ============================================================================
+// SSAO QUALITY-VS-COST AUTOTUNER
+// ============================================================================
+//
+// Sweeps Samples x BlurRadius x ResolutionScale headlessly over captured
+// (CaptureFrames) or built-in synthetic scenes. For every setting it
+// measures per-pass GPU time and compares the AO-only output against a
+// high-sample full-resolution reference (PSNR, SSIM). The Pareto-optimal
+// settings are reported and the cheapest one meeting each quality bar is
+// written as a named tier for the mod's Preset / PresetFile options.
+//
+// Radius, Density and the multi-resolution settings change the look rather
+// than the quality, so they are held at the capture's (or command line)
+// values and copied into every tier. Timings come from whatever GLES
+// driver runs the tool; they rank settings, absolute numbers need a
+// device-class GPU.
+//
+// Build (Linux, any EGL with GLES 3, e.g. Mesa llvmpipe):
+//   g++ -std=c++17 -O2 -Itools/headless -Ijni tools/ssao_autotune.cpp
+//       -o ssao_autotune -lEGL -lGLESv2 -ldl
+//
+// Usage:
+//   ssao_autotune [scene.ssac ...] [--size WxH] [--frames N] [--out presets.ini]
+//                 [--samples 4,8,16] [--blur 0,2,3] [--scales 0.5,0.75]
+//                 [Key=Value ...]
+
+#include "SSAO_Complete.cpp"
+#include "headless_gl.h"
+#include "ssao_scenes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// MEASUREMENT
+// ============================================================================
+
+struct PassTimer {
+    const char* current = nullptr;
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::pair<std::string, double>> totals;
+    
+    void Mark(const char* pass) {
+        glFinish();
+        auto now = std::chrono::steady_clock::now();
+        if(current) {
+            double ms = std::chrono::duration<double, std::milli>(now - start).count();
+            auto it = std::find_if(totals.begin(), totals.end(),
+                                   [this](const std::pair<std::string, double>& p) {
+                                       return p.first == current;
+                                   });
+            if(it == totals.end()) totals.push_back({ current, ms });
+            else it->second += ms;
+        }
+        current = pass;
+        start = now;
+    }
+} passTimer;
+
+static void PassTimerHook(const char* pass) {
+    passTimer.Mark(pass);
+}
+
+// Mean SSIM over 8x8 windows with a stride of 4
+static double SSIM(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b,
+                   int width, int height) {
+    const double c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+    double total = 0.0;
+    int windows = 0;
+    
+    for(int y = 0; y + 8 <= height; y += 4) {
+        for(int x = 0; x + 8 <= width; x += 4) {
+            double ma = 0, mb = 0, va = 0, vb = 0, cov = 0;
+            for(int j = 0; j < 8; j++) {
+                for(int i = 0; i < 8; i++) {
+                    size_t k = (size_t)(y + j) * width + x + i;
+                    ma += a[k];
+                    mb += b[k];
+                }
+            }
+            ma /= 64.0;
+            mb /= 64.0;
+            for(int j = 0; j < 8; j++) {
+                for(int i = 0; i < 8; i++) {
+                    size_t k = (size_t)(y + j) * width + x + i;
+                    double da = a[k] - ma, db = b[k] - mb;
+                    va += da * da;
+                    vb += db * db;
+                    cov += da * db;
+                }
+            }
+            va /= 63.0;
+            vb /= 63.0;
+            cov /= 63.0;
+            total += ((2 * ma * mb + c1) * (2 * cov + c2)) /
+                     ((ma * ma + mb * mb + c1) * (va + vb + c2));
+            windows++;
+        }
+    }
+    return windows ? total / windows : 1.0;
+}
+
+// ============================================================================
+// SWEEP
+// ============================================================================
+
+struct Setting {
+    int samples;
+    int blurRadius; // 0 = blur off
+    float scale;
+    
+    double ms = 0.0;
+    double psnr = 0.0, ssim = 0.0;
+    std::vector<std::pair<std::string, double>> passes;
+    bool pareto = false;
+    
+    Setting(int samples, int blurRadius, float scale)
+        : samples(samples), blurRadius(blurRadius), scale(scale) {}
+};
+
+static void ApplySetting(int samples, int blurRadius, float scale) {
+    char value[32];
+    snprintf(value, sizeof(value), "%d", samples);
+    cfg->Set("Samples", value);
+    cfg->Set("BlurEnabled", blurRadius > 0 ? "1" : "0");
+    snprintf(value, sizeof(value), "%d", blurRadius > 0 ? blurRadius : 1);
+    cfg->Set("BlurRadius", value);
+    snprintf(value, sizeof(value), "%g", scale);
+    cfg->Set("ResolutionScale", value);
+}
+
+template<typename T>
+static std::vector<T> ParseList(const char* list) {
+    std::vector<T> out;
+    for(const char* p = list; *p; ) {
+        out.push_back((T)atof(p));
+        p = strchr(p, ',');
+        if(!p) break;
+        p++;
+    }
+    return out;
+}
+
+struct Tier {
+    const char* name;
+    double minSSIM;
+};
+
+int main(int argc, char** argv) {
+    std::vector<int> samplesGrid = { 4, 6, 8, 12, 16, 24 };
+    std::vector<int> blurGrid = { 0, 1, 2, 3, 5 };
+    std::vector<float> scaleGrid = { 0.5f, 0.75f, 1.0f };
+    int width = 640, height = 360, frames = 4;
+    const char* outPath = nullptr;
+    std::vector<const char*> captures;
+    std::vector<const char*> overrides;
+    
+    const Tier tiers[] = {
+        { "Low",    0.85 },
+        { "Medium", 0.90 },
+        { "High",   0.95 },
+        { "Ultra",  0.97 },
+    };
+    
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--size") && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = std::max(1, atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if(!strcmp(argv[i], "--samples") && i + 1 < argc) {
+            samplesGrid = ParseList<int>(argv[++i]);
+        } else if(!strcmp(argv[i], "--blur") && i + 1 < argc) {
+            blurGrid = ParseList<int>(argv[++i]);
+        } else if(!strcmp(argv[i], "--scales") && i + 1 < argc) {
+            scaleGrid = ParseList<float>(argv[++i]);
+        } else if(strchr(argv[i], '=')) {
+            overrides.push_back(argv[i]);
+        } else {
+            captures.push_back(argv[i]);
+        }
+    }
+    
+    OnModPreLoad();
+    
+    std::vector<Scene> scenes;
+    std::vector<SSAOCaptureReader> readers(captures.size());
+    for(size_t i = 0; i < captures.size(); i++) {
+        // The first capture's recorded config provides Radius, Density etc.
+        if(LoadCaptureScene(scenes, readers[i], captures[i]) && scenes.size() == 1)
+            cfg->Apply(readers[i].header->config);
+    }
+    if(captures.empty())
+        MakeSyntheticScenes(scenes, width, height);
+    if(scenes.empty()) {
+        logger->Error("No scenes to tune on");
+        return 1;
+    }
+    
+    for(const char* o : overrides) cfg->Apply(o);
+    cfg->Set("DebugMode", "1");
+    cfg->Set("StaticReuse", "0"); // repeated frames must pay for the full AO
+    
+    int maxWidth = 0, maxHeight = 0;
+    for(const Scene& s : scenes) {
+        maxWidth = std::max(maxWidth, s.width);
+        maxHeight = std::max(maxHeight, s.height);
+    }
+    
+    HeadlessGL gl;
+    if(!gl.Create(maxWidth, maxHeight)) return 1;
+    
+    logger->quiet = true;
+    if(!InitShaders() || !InitGeometry()) {
+        logger->Error("Failed to initialize the SSAO pipeline");
+        return 1;
+    }
+    
+    // Reference: many taps, full resolution, default blur
+    std::vector<std::vector<unsigned char>> references;
+    ApplySetting(64, 3, 1.0f);
+    for(const Scene& s : scenes) {
+        glViewport(0, 0, s.width, s.height);
+        ResetFrameHistory();
+        RenderScene(s);
+        references.push_back(ReadAO(s.width, s.height));
+    }
+    
+    std::vector<Setting> settings;
+    for(int samples : samplesGrid)
+        for(int blur : blurGrid)
+            for(float scale : scaleGrid)
+                settings.emplace_back(samples, blur, scale);
+    
+    printf("%zu scenes, %zu settings, %d timed frames each\n",
+           scenes.size(), settings.size(), frames);
+    
+    ssaoPassHook = PassTimerHook;
+    for(Setting& st : settings) {
+        ApplySetting(st.samples, st.blurRadius, st.scale);
+        passTimer.totals.clear();
+        
+        for(size_t i = 0; i < scenes.size(); i++) {
+            const Scene& s = scenes[i];
+            glViewport(0, 0, s.width, s.height);
+            
+            // No AO carries over from the previous scene. The untimed
+            // warm-up also settles render target reallocation.
+            ResetFrameHistory();
+            ssaoPassHook = nullptr;
+            RenderScene(s);
+            ssaoPassHook = PassTimerHook;
+            
+            for(int f = 0; f < frames; f++)
+                RenderScene(s);
+            
+            std::vector<unsigned char> ao = ReadAO(s.width, s.height);
+            st.psnr += PSNR(ao, references[i]);
+            st.ssim += SSIM(ao, references[i], s.width, s.height);
+        }
+        
+        double runs = (double)frames * scenes.size();
+        for(auto& p : passTimer.totals) {
+            p.second /= runs;
+            if(p.first != "upload") st.ms += p.second;
+        }
+        st.passes = passTimer.totals;
+        st.psnr /= scenes.size();
+        st.ssim /= scenes.size();
+    }
+    ssaoPassHook = nullptr;
+    
+    // Pareto front: no other setting is both cheaper and better
+    for(Setting& a : settings) {
+        a.pareto = true;
+        for(const Setting& b : settings) {
+            if(&a != &b && b.ms <= a.ms && b.ssim >= a.ssim &&
+               (b.ms < a.ms || b.ssim > a.ssim)) {
+                a.pareto = false;
+                break;
+            }
+        }
+    }
+    
+    std::sort(settings.begin(), settings.end(),
+              [](const Setting& a, const Setting& b) { return a.ms < b.ms; });
+    
+    printf("\n%-8s %-5s %-6s %9s %8s %7s  %s\n",
+           "samples", "blur", "scale", "ms", "psnr", "ssim", "passes (ms)");
+    for(const Setting& st : settings) {
+        printf("%-8d %-5d %-6.2f %9.3f %8.2f %7.4f  ",
+               st.samples, st.blurRadius, st.scale, st.ms, st.psnr, st.ssim);
+        for(const auto& p : st.passes)
+            printf("%s=%.3f ", p.first.c_str(), p.second);
+        printf("%s\n", st.pareto ? "*" : "");
+    }
+    
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if(!out) {
+        logger->Error("Cannot write %s", outPath);
+        return 1;
+    }
+    if(!outPath) printf("\n");
+    
+    fprintf(out, "; SSAO device tiers generated by ssao_autotune\n");
+    fprintf(out, "; Scenes:");
+    for(const Scene& s : scenes) fprintf(out, " %s", s.name.c_str());
+    fprintf(out, "\n");
+    
+    for(const Tier& tier : tiers) {
+        const Setting* pick = nullptr;
+        for(const Setting& st : settings) {
+            if(st.pareto && st.ssim >= tier.minSSIM) {
+                pick = &st;
+                break;
+            }
+        }
+        if(!pick) {
+            fprintf(out, "; %s: no setting reaches SSIM %.2f\n", tier.name, tier.minSSIM);
+            continue;
+        }
+        
+        fprintf(out, "\n[%s]\n", tier.name);
+        fprintf(out, "; %.3f ms, PSNR %.2f dB, SSIM %.4f\n", pick->ms, pick->psnr, pick->ssim);
+        fprintf(out, "Samples=%d\n", pick->samples);
+        fprintf(out, "BlurEnabled=%d\n", pick->blurRadius > 0 ? 1 : 0);
+        fprintf(out, "BlurRadius=%d\n", pick->blurRadius > 0 ? pick->blurRadius : 1);
+        fprintf(out, "ResolutionScale=%g\n", pick->scale);
+        fprintf(out, "Radius=%g\n", pRadius->GetFloat());
+        fprintf(out, "Density=%g\n", pDensity->GetFloat());
+        fprintf(out, "MultiResolution=%d\n", pMultiRes->GetBool() ? 1 : 0);
+    }
+    
+    if(outPath) {
+        fclose(out);
+        printf("\npresets written to %s\n", outPath);
+    }
+    
+    for(SSAOCaptureReader& r : readers) r.Close();
+    gl.Destroy();
+    return 0;
+}
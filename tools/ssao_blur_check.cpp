@@ -0,0 +1,153 @@
+// ============================================================================
+// SSAO BILATERAL BLUR CHECK
+// ============================================================================
+//
+// Compares the blur passes against a direct evaluation of the kernel they
+// implement: a separable Gaussian (sigma^2 = 2) over BlurRadius texels,
+// each tap weighted by exp(-50 |dz|) against the centre depth, edge texels
+// clamped, sky pixels left at 1. The unblurred AO of each synthetic scene
+// is read back with BlurEnabled=0, blurred on the CPU and compared with
+// the output of BlurEnabled=1, at ResolutionScale 1 so AO and depth
+// texels line up.
+//
+// The fetch path is picked at init like in the game: textureGather on
+// GLES 3.1 unless TextureGather=0 is given.
+//
+// Build (Linux, any EGL with GLES 3, e.g. Mesa llvmpipe):
+//   g++ -std=c++17 -O2 -Itools/headless -Ijni tools/ssao_blur_check.cpp
+//       -o ssao_blur_check -lEGL -lGLESv2 -ldl
+//
+// Usage:
+//   ssao_blur_check [--size WxH] [Key=Value ...]
+//
+// Exits with 1 if any scene and radius falls below the PSNR bar or has a
+// pixel further off than the error bar.
+
+#include "SSAO_Complete.cpp"
+#include "headless_gl.h"
+#include "ssao_scenes.h"
+
+#define CHECK_MIN_PSNR 45.0
+#define CHECK_MAX_ERROR 4 // of 255, covers the 8-bit readback of the input
+
+// Window depth in [0,1] as the depth texture returns it, edge-clamped
+static float SceneDepth(const Scene& s, int x, int y) {
+    x = std::min(std::max(x, 0), s.width - 1);
+    y = std::min(std::max(y, 0), s.height - 1);
+    size_t i = (size_t)y * s.width + x;
+    if(s.depthBits == 16) return ((const uint16_t*)s.depth)[i] / 65535.0f;
+    if(s.depthBits == 32) return ((const float*)s.depth)[i];
+    return (float)((((const uint32_t*)s.depth)[i] >> 8) / 16777215.0);
+}
+
+// One bilateral pass along (dx, dy) over a float image
+static std::vector<float> BlurPass(const std::vector<float>& in, const Scene& s,
+                                   int radius, int dx, int dy) {
+    std::vector<float> out(in.size());
+    for(int y = 0; y < s.height; y++) {
+        for(int x = 0; x < s.width; x++) {
+            float center = SceneDepth(s, x, y);
+            if(center >= 0.9999f) {
+                out[(size_t)y * s.width + x] = 1.0f;
+                continue;
+            }
+            
+            double total = 0.0, weights = 0.0;
+            for(int k = -radius; k <= radius; k++) {
+                int sx = std::min(std::max(x + k * dx, 0), s.width - 1);
+                int sy = std::min(std::max(y + k * dy, 0), s.height - 1);
+                double w = exp(-(double)(k * k) * 0.25) *
+                           exp(-fabs((double)center - SceneDepth(s, sx, sy)) * 50.0);
+                total += in[(size_t)sy * s.width + sx] * w;
+                weights += w;
+            }
+            out[(size_t)y * s.width + x] = (float)(total / weights);
+        }
+    }
+    return out;
+}
+
+// Rows bottom-up like glReadPixels, the scene depth is stored the same way
+static std::vector<unsigned char> BlurReference(const std::vector<unsigned char>& ao,
+                                                const Scene& s, int radius) {
+    std::vector<float> image(ao.size());
+    for(size_t i = 0; i < ao.size(); i++) image[i] = ao[i] / 255.0f;
+    
+    image = BlurPass(image, s, radius, 1, 0);
+    image = BlurPass(image, s, radius, 0, 1);
+    
+    std::vector<unsigned char> out(image.size());
+    for(size_t i = 0; i < image.size(); i++)
+        out[i] = (unsigned char)std::min(255.0f, std::max(0.0f, image[i] * 255.0f + 0.5f));
+    return out;
+}
+
+int main(int argc, char** argv) {
+    int width = 320, height = 180;
+    std::vector<const char*> overrides;
+    
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--size") && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(strchr(argv[i], '=')) {
+            overrides.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "usage: %s [--size WxH] [Key=Value ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    OnModPreLoad();
+    for(const char* o : overrides) cfg->Apply(o);
+    cfg->Set("DebugMode", "1");
+    cfg->Set("StaticReuse", "0");
+    cfg->Set("ResolutionScale", "1");
+    
+    std::vector<Scene> scenes;
+    MakeSyntheticScenes(scenes, width, height);
+    
+    HeadlessGL gl;
+    if(!gl.Create(width, height, 1)) return 1;
+    
+    logger->quiet = true;
+    if(!InitShaders() || !InitGeometry()) {
+        logger->Error("Failed to initialize the SSAO pipeline");
+        return 1;
+    }
+    printf("%s fetch path\n\n", textureGatherPath ? "textureGather" : "bilinear");
+    printf("%-24s radius     psnr  max error\n", "scene");
+    
+    const int radii[] = { 1, 2, 3, 5, 8 };
+    bool ok = true;
+    glViewport(0, 0, width, height);
+    for(const Scene& s : scenes) {
+        cfg->Set("BlurEnabled", "0");
+        ResetFrameHistory();
+        RenderScene(s);
+        std::vector<unsigned char> ao = ReadAO(s.width, s.height);
+        
+        for(int radius : radii) {
+            char value[16];
+            snprintf(value, sizeof(value), "%d", radius);
+            cfg->Set("BlurRadius", value);
+            cfg->Set("BlurEnabled", "1");
+            ResetFrameHistory();
+            RenderScene(s);
+            std::vector<unsigned char> blurred = ReadAO(s.width, s.height);
+            std::vector<unsigned char> reference = BlurReference(ao, s, radius);
+            
+            int maxError = 0;
+            for(size_t i = 0; i < blurred.size(); i++)
+                maxError = std::max(maxError, abs((int)blurred[i] - (int)reference[i]));
+            double psnr = PSNR(blurred, reference);
+            
+            bool pass = psnr >= CHECK_MIN_PSNR && maxError <= CHECK_MAX_ERROR;
+            if(!pass) ok = false;
+            printf("%-24s %6d %8.2f %10d%s\n", s.name.c_str(), radius, psnr, maxError,
+                   pass ? "" : "  FAIL");
+        }
+    }
+    
+    printf("\n%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// ============================================================================
+// SSAO CAMERA MATH CHECK AND BENCHMARK
+// ============================================================================
+//
+// Checks the specialised inverses behind UpdateCameraConstants against the
+// generic Matrix4x4Invert, then times all three. Views are random rigid
+// transforms; projections are symmetric, off-axis and oblique (the last
+// must be rejected by Mat4InvertPerspective and UpdateCameraConstants).
+// For the accepted projections, view positions rebuilt from projInfo and
+// depthParams the way the AO shaders do are checked against the points
+// that were projected.
+//
+// Build (Linux, same flags as ssao_replay; no GL context is created):
+//   g++ -std=c++17 -O2 -Itools/headless -Ijni tools/ssao_camera_bench.cpp
+//       -o ssao_camera_bench -lEGL -lGLESv2 -ldl
+//
+// Usage:
+//   ssao_camera_bench [--iterations N]
+//
+// Exits with 1 if any inverse is off by more than the tolerance.
+
+#include "SSAO_Complete.cpp"
+
+#include <chrono>
+#include <vector>
+
+#define BENCH_MATRICES 256
+#define BENCH_TOLERANCE 1e-4f
+#define BENCH_POINTS 64
+#define BENCH_POSITION_TOLERANCE 5e-3f // relative to the view depth; float depth near 1 costs ~1e-3
+
+static uint32_t rngState = 12345u;
+
+static float Random(float lo, float hi) {
+    rngState = rngState * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(rngState >> 8) / 16777216.0f;
+}
+
+// Column-major rotation from a random unit quaternion plus a translation
+static void RandomRigid(float* m) {
+    float x = Random(-1, 1), y = Random(-1, 1), z = Random(-1, 1), w = Random(-1, 1);
+    float n = sqrtf(x*x + y*y + z*z + w*w);
+    x /= n;
+    y /= n;
+    z /= n;
+    w /= n;
+    
+    float r[16] = {
+        1 - 2*(y*y + z*z), 2*(x*y + w*z),     2*(x*z - w*y),     0,
+        2*(x*y - w*z),     1 - 2*(x*x + z*z), 2*(y*z + w*x),     0,
+        2*(x*z + w*y),     2*(y*z - w*x),     1 - 2*(x*x + y*y), 0,
+        Random(-3000, 3000), Random(-3000, 3000), Random(-200, 200), 1,
+    };
+    memcpy(m, r, sizeof(r));
+}
+
+enum ProjectionKind { PROJ_SYMMETRIC, PROJ_OFF_AXIS, PROJ_OBLIQUE, PROJ_KINDS };
+static const char* projectionNames[PROJ_KINDS] = { "symmetric", "off-axis", "oblique" };
+
+static void RandomProjection(float* p, ProjectionKind kind) {
+    float n = Random(0.05f, 2.0f), f = Random(100.0f, 3000.0f);
+    float fy = 1.0f / tanf(Random(0.3f, 0.7f));
+    
+    memset(p, 0, 16 * sizeof(float));
+    p[0] = fy / Random(1.0f, 2.4f);
+    p[5] = fy;
+    p[10] = -(f + n) / (f - n);
+    p[11] = -1.0f;
+    p[14] = -2.0f * f * n / (f - n);
+    
+    if(kind != PROJ_SYMMETRIC) {
+        p[8] = Random(-0.3f, 0.3f);
+        p[9] = Random(-0.3f, 0.3f);
+    }
+    if(kind == PROJ_OBLIQUE) {
+        // Near plane replaced by a tilted clip plane
+        p[2] = Random(-0.2f, 0.2f);
+        p[6] = Random(-0.2f, 0.2f);
+    }
+}
+
+// Projects random view-space points in front of the camera to uv and
+// [0,1] depth, rebuilds them as getViewPosition() does and returns the
+// largest error relative to the point's depth
+static float ReconstructionError(const float* proj, const CameraConstants& cc) {
+    float worst = 0.0f;
+    for(int i = 0; i < BENCH_POINTS; i++) {
+        float z = -Random(0.5f, 500.0f);
+        float v[4] = { Random(-0.5f, 0.5f) * z, Random(-0.3f, 0.3f) * z, z, 1.0f };
+        
+        float clip[4];
+        for(int r = 0; r < 4; r++)
+            clip[r] = proj[r] * v[0] + proj[4 + r] * v[1] + proj[8 + r] * v[2] + proj[12 + r];
+        float u = 0.5f * clip[0] / clip[3] + 0.5f;
+        float t = 0.5f * clip[1] / clip[3] + 0.5f;
+        float depth = 0.5f * clip[2] / clip[3] + 0.5f;
+        
+        float rz = cc.depthParams[0] / (depth - cc.depthParams[1]);
+        float rx = (u * cc.projInfo[0] + cc.projInfo[2]) * rz;
+        float ry = (t * cc.projInfo[1] + cc.projInfo[3]) * rz;
+        float err = fmaxf(fabsf(rx - v[0]), fmaxf(fabsf(ry - v[1]), fabsf(rz - v[2])));
+        worst = fmaxf(worst, err / fabsf(z));
+    }
+    return worst;
+}
+
+// Largest element difference, relative to the matrix's largest element
+static float MaxError(const float* a, const float* b) {
+    float err = 0.0f, scale = 1.0f;
+    for(int i = 0; i < 16; i++) {
+        err = fmaxf(err, fabsf(a[i] - b[i]));
+        scale = fmaxf(scale, fabsf(b[i]));
+    }
+    return err / scale;
+}
+
+template<typename F>
+static double NanosecondsPerCall(const std::vector<float>& matrices, int iterations, F invert) {
+    float out[16];
+    float checksum = 0.0f;
+    int count = (int)matrices.size() / 16;
+    
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++) {
+        invert(&matrices[(size_t)(i % count) * 16], out);
+        checksum += out[i & 15];
+    }
+    auto end = std::chrono::steady_clock::now();
+    
+    // Keeps the loop from being optimised away
+    if(checksum == 12345.0f) printf(" ");
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10000000;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    OnModPreLoad();
+    bool ok = true;
+    
+    std::vector<float> views(BENCH_MATRICES * 16);
+    float worstRigid = 0.0f;
+    for(int i = 0; i < BENCH_MATRICES; i++) {
+        float* v = &views[(size_t)i * 16];
+        RandomRigid(v);
+        
+        float fast[16], ref[16];
+        if(!Mat4InvertRigid(v, fast) || !Matrix4x4Invert(v, ref)) {
+            printf("FAIL rigid matrix %d not inverted\n", i);
+            ok = false;
+            continue;
+        }
+        worstRigid = fmaxf(worstRigid, MaxError(fast, ref));
+    }
+    printf("rigid view:       max error %.2e\n", worstRigid);
+    if(worstRigid > BENCH_TOLERANCE) ok = false;
+    
+    std::vector<float> projections(BENCH_MATRICES * 16);
+    for(int kind = 0; kind < PROJ_KINDS; kind++) {
+        float worst = 0.0f;
+        int unsupported = 0;
+        for(int i = 0; i < BENCH_MATRICES; i++) {
+            float* p = &projections[(size_t)i * 16];
+            RandomProjection(p, (ProjectionKind)kind);
+            
+            float fast[16], ref[16];
+            if(!Matrix4x4Invert(p, ref)) {
+                printf("FAIL %s projection %d is singular\n", projectionNames[kind], i);
+                ok = false;
+                continue;
+            }
+            if(!Mat4InvertPerspective(p, fast)) {
+                unsupported++;
+                continue;
+            }
+            worst = fmaxf(worst, MaxError(fast, ref));
+        }
+        
+        // Only the oblique matrices fall outside the analytic layout
+        bool expectUnsupported = kind == PROJ_OBLIQUE;
+        if(unsupported != (expectUnsupported ? BENCH_MATRICES : 0)) ok = false;
+        if(worst > BENCH_TOLERANCE) ok = false;
+        printf("%-9s proj:   max error %.2e, %d/%d not plain perspective\n",
+               projectionNames[kind], worst, unsupported, BENCH_MATRICES);
+        
+        // The camera constants take every projection the shaders can
+        // rebuild view space from, and only those. One oblique matrix is
+        // enough, each rejection logs an error.
+        float view[16];
+        RandomRigid(view);
+        float worstPosition = 0.0f;
+        int tested = expectUnsupported ? 1 : BENCH_MATRICES;
+        int rejected = 0;
+        for(int i = 0; i < tested; i++) {
+            const float* p = &projections[(size_t)i * 16];
+            camConsts.valid = false;
+            if(!UpdateCameraConstants(view, p, 0.1f, 1000.0f)) {
+                rejected++;
+                continue;
+            }
+            worstPosition = fmaxf(worstPosition, ReconstructionError(p, camConsts));
+        }
+        if(rejected != (expectUnsupported ? tested : 0)) ok = false;
+        if(worstPosition > BENCH_POSITION_TOLERANCE) ok = false;
+        printf("%-9s view:   max error %.2e, %d/%d rejected\n",
+               projectionNames[kind], worstPosition, rejected, tested);
+    }
+    
+    // Projections are timed on the off-axis set, which both inverses handle
+    std::vector<float> offAxis(BENCH_MATRICES * 16);
+    for(int i = 0; i < BENCH_MATRICES; i++)
+        RandomProjection(&offAxis[(size_t)i * 16], PROJ_OFF_AXIS);
+    
+    printf("\n%d calls each:\n", iterations);
+    printf("  Matrix4x4Invert (view)   %7.2f ns\n", NanosecondsPerCall(views, iterations, Matrix4x4Invert));
+    printf("  Mat4InvertRigid          %7.2f ns\n", NanosecondsPerCall(views, iterations, Mat4InvertRigid));
+    printf("  Matrix4x4Invert (proj)   %7.2f ns\n", NanosecondsPerCall(offAxis, iterations, Matrix4x4Invert));
+    printf("  Mat4InvertPerspective    %7.2f ns\n", NanosecondsPerCall(offAxis, iterations, Mat4InvertPerspective));
+    
+    printf("\n%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+// ============================================================================
+// SSAO CAPTURE REPLAY
+// ============================================================================
+//
+// Streams a capture written with CaptureFrames through the mod's SSAO
+// pipeline on a desktop, without the game. Depth payloads are uploaded
+// straight from the mapped file.
+//
+// Build (Linux, any EGL with GLES 3, e.g. Mesa llvmpipe):
+//   g++ -std=c++17 -O2 -Itools/headless -Ijni tools/ssao_replay.cpp
+//       -o ssao_replay -lEGL -lGLESv2 -ldl
+//
+// Usage:
+//   ssao_replay capture.ssac [--loops N] [--dump last.pgm] [Key=Value ...]
+//
+// Key=Value pairs override the config recorded in the capture.
+//
+// Built with -DSSAO_GL_TRACE, TraceFrames=N TracePath=trace.json traces
+// the GL calls of the first N frames and prints per-frame averages.
+
+#include "SSAO_Complete.cpp"
+#include "headless_gl.h"
+
+#include <chrono>
+#include <vector>
+
+static void DumpPGM(const char* path, int width, int height) {
+    std::vector<unsigned char> pixels((size_t)width * height * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    
+    FILE* f = fopen(path, "wb");
+    if(!f) {
+        logger->Error("Cannot write %s", path);
+        return;
+    }
+    fprintf(f, "P5 %d %d 255\n", width, height);
+    for(int y = height - 1; y >= 0; y--)
+        for(int x = 0; x < width; x++)
+            fputc(pixels[((size_t)y * width + x) * 4], f);
+    fclose(f);
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s capture.ssac [--loops N] [--dump out.pgm] [Key=Value ...]\n", argv[0]);
+        return 1;
+    }
+    
+    SSAOCaptureReader reader;
+    if(!reader.Open(argv[1])) {
+        logger->Error("Not a readable SSAO capture: %s", argv[1]);
+        return 1;
+    }
+    
+    int loops = 1;
+    const char* dumpPath = nullptr;
+    
+    OnModPreLoad();
+    cfg->Apply(reader.header->config);
+    
+    for(int i = 2; i < argc; i++) {
+        if(!strcmp(argv[i], "--loops") && i + 1 < argc) {
+            loops = atoi(argv[++i]);
+        } else if(!strcmp(argv[i], "--dump") && i + 1 < argc) {
+            dumpPath = argv[++i];
+        } else {
+            cfg->Apply(argv[i]);
+        }
+    }
+    
+    SSAOCaptureView view;
+    if(!reader.Next(view)) {
+        logger->Error("Capture has no frames");
+        return 1;
+    }
+    int width = view.frame->targetWidth;
+    int height = view.frame->targetHeight;
+    reader.Rewind();
+    
+    HeadlessGL gl;
+    if(!gl.Create(width, height)) return 1;
+    
+    logger->quiet = true;
+    if(!InitShaders() || !InitGeometry()) {
+        logger->Error("Failed to initialize the SSAO pipeline");
+        return 1;
+    }
+    
+    printf("capture: %s, %u frames, %dx%d\n", argv[1], reader.header->frameCount, width, height);
+    printf("config: %s\n", reader.header->config);
+    
+    double total = 0.0, best = 1e9, worst = 0.0;
+    int frames = 0;
+    
+    for(int loop = 0; loop < loops; loop++) {
+        reader.Rewind();
+        while(reader.Next(view)) {
+            const SSAOCaptureFrame& f = *view.frame;
+            
+            SSAOFrameInput in;
+            in.depthPixels = view.depth;
+            in.depthWidth = f.width;
+            in.depthHeight = f.height;
+            in.depthBits = f.depthBits;
+            in.viewMatrix = f.viewMatrix;
+            in.projMatrix = f.projMatrix;
+            in.nearPlane = f.nearPlane;
+            in.farPlane = f.farPlane;
+            in.width = f.targetWidth;
+            in.height = f.targetHeight;
+            
+            glFinish();
+            auto start = std::chrono::steady_clock::now();
+            RenderSSAOFrame(in);
+            glFinish();
+            double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            
+            GLenum err = glGetError();
+            if(err != GL_NO_ERROR) {
+                logger->Error("GL error 0x%x on frame %u", err, f.index);
+                return 1;
+            }
+            
+            total += ms;
+            if(ms < best) best = ms;
+            if(ms > worst) worst = ms;
+            frames++;
+        }
+    }
+    
+    if(!frames) {
+        logger->Error("No frames replayed");
+        return 1;
+    }
+    
+    printf("frames: %d, avg %.3f ms, min %.3f ms, max %.3f ms\n",
+           frames, total / frames, best, worst);
+    
+#ifdef SSAO_GL_TRACE
+    const SSAOTraceFrameStats& t = ssaoGLTrace.total;
+    if(t.frames) {
+        printf("trace: %u frames, per frame %.1f calls, %.1f redundant binds, "
+               "%.1f redundant uniforms, %.1f stalls, %.3f ms CPU\n",
+               t.frames, (double)t.calls / t.frames, (double)t.redundantBinds / t.frames,
+               (double)t.redundantUniforms / t.frames, (double)t.stalls / t.frames, t.cpuMs / t.frames);
+    }
+#endif
+    
+    if(dumpPath) DumpPGM(dumpPath, width, height);
+    
+    reader.Close();
+    gl.Destroy();
+    return 0;
+}